@@ -0,0 +1,71 @@
+// Decoder for the binary plot protocol of the native library (see BinaryProtocol.hpp)
+// All values are little endian.
+
+export enum BinaryMessageType {
+	// [u8 type][u16 count] count x ([u16 seriesId][u8 nameLength][name bytes])
+	SeriesTable = 1,
+	// [u8 type][u16 count][f64 baseTimestampUs] count x ([u16 seriesId][varint timestampDeltaUs][f32 value])
+	// Timestamp deltas are relative to the previous sample (the first to baseTimestampUs), zigzag and LEB128 encoded
+	Samples = 2,
+}
+
+export type SampleHandler = (series: string, timestampUs: number, value: number) => void;
+
+// Keeps the series id -> name table of one connection
+export class BinaryProtocolDecoder {
+	private readonly seriesNames = new Map<number, string>();
+	private readonly textDecoder = new TextDecoder();
+
+	public decode(buffer: ArrayBuffer, onSample: SampleHandler) {
+		const view = new DataView(buffer);
+		const messageType = view.getUint8(0);
+
+		if (messageType === BinaryMessageType.SeriesTable) this.decodeSeriesTable(view);
+		else if (messageType === BinaryMessageType.Samples) this.decodeSamples(view, onSample);
+	}
+
+	private decodeSeriesTable(view: DataView) {
+		const count = view.getUint16(1, true);
+		let offset = 3;
+		for (let i = 0; i < count; i++) {
+			const id = view.getUint16(offset, true);
+			const nameLength = view.getUint8(offset + 2);
+			offset += 3;
+
+			const name = this.textDecoder.decode(new Uint8Array(view.buffer, view.byteOffset + offset, nameLength));
+			offset += nameLength;
+
+			this.seriesNames.set(id, name);
+		}
+	}
+
+	private decodeSamples(view: DataView, onSample: SampleHandler) {
+		const count = view.getUint16(1, true);
+		let timestampUs = view.getFloat64(3, true);
+		let offset = 11;
+		for (let i = 0; i < count; i++) {
+			const id = view.getUint16(offset, true);
+			offset += 2;
+
+			// Varints are decoded with arithmetic instead of bit operations, which are limited to 32 bit
+			let zigzag = 0;
+			let multiplier = 1;
+			let byte: number;
+			do {
+				byte = view.getUint8(offset++);
+				zigzag += (byte & 0x7f) * multiplier;
+				multiplier *= 128;
+			} while (byte & 0x80);
+			timestampUs += zigzag % 2 === 0 ? zigzag / 2 : -(zigzag + 1) / 2;
+
+			const value = view.getFloat32(offset, true);
+			offset += 4;
+
+			const name = this.seriesNames.get(id);
+			// Samples of series that were not announced yet are skipped
+			if (name === undefined) continue;
+
+			onSample(name, timestampUs, value);
+		}
+	}
+}
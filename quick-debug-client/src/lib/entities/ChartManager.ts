@@ -112,11 +112,13 @@ export class ChartManager {
 		}
 	}
 
-	public plot(dataFlow: string, value: number) {
+	// Samples with a timestamp (microseconds since startup of the device) are placed at the time they were plotted,
+	// samples without one at the next point of the arrival counter
+	public plot(dataFlow: string, value: number, timestampUs?: number) {
 		const chartIdx = ReadWritable(this.chartMap).get(dataFlow);
 		if (chartIdx === undefined) {
 			this.addDataFlow(dataFlow);
-			this.plot(dataFlow, value);
+			this.plot(dataFlow, value, timestampUs);
 			return;
 		}
 
@@ -128,16 +130,23 @@ export class ChartManager {
 		const series = chart.Series.find(x => x.Series.dataSeries.dataSeriesName === dataFlow);
 		if (series === undefined) {
 			this.createSeries(dataFlow, chart, ReadWritable(plottingInterval));
-			this.plot(dataFlow, value);
+			this.plot(dataFlow, value, timestampUs);
 			return;
 		}
 
-		// Update the axis plot point for this series and the chart
-		// This is used to plot new data for different data flows at the same x point
-		series.AxisPlotPoint++
-		const newPlotPoint = Math.max(series.AxisPlotPoint, chart.AxisFurthestPlotPoint);
-		chart.AxisFurthestPlotPoint = newPlotPoint;
-		series.AxisPlotPoint = newPlotPoint;
+		if (timestampUs !== undefined) {
+			// Seconds since startup of the device. Samples of different threads may arrive slightly out of order,
+			// they are clamped since the data series has to stay sorted
+			series.AxisPlotPoint = Math.max(timestampUs / 1e6, series.AxisPlotPoint);
+		}
+		else {
+			// Update the axis plot point for this series and the chart
+			// This is used to plot new data for different data flows at the same x point
+			series.AxisPlotPoint++
+			const newPlotPoint = Math.max(series.AxisPlotPoint, chart.AxisFurthestPlotPoint);
+			chart.AxisFurthestPlotPoint = newPlotPoint;
+			series.AxisPlotPoint = newPlotPoint;
+		}
 
 		const xySeries = series.Series.dataSeries as XyDataSeries;
 		xySeries.append(series.AxisPlotPoint, value);
@@ -150,10 +159,10 @@ export class ChartManager {
 
 		if (chartSurface.zoomState !== EZoomState.UserZooming) {
 			chartSurface.zoomExtentsY();
-			chartSurface.xAxes.get(0).visibleRange = new NumberRange(
-				series.AxisPlotPoint - series.Series.dataSeries.fifoCapacity!,
-				series.AxisPlotPoint
-			);
+			const firstPlotPoint = timestampUs !== undefined
+				? xySeries.getXRange().min
+				: series.AxisPlotPoint - series.Series.dataSeries.fifoCapacity!;
+			chartSurface.xAxes.get(0).visibleRange = new NumberRange(firstPlotPoint, series.AxisPlotPoint);
 		}
 	}
 
@@ -9,6 +9,8 @@ export enum ConnectionState {
 
 export class IpData {
 	public Socket: WebSocket | null = null;
+	// Data flows the device was asked not to send, reset on every connect
+	public UnsubscribedDataFlows = new Set<string>();
 
 	constructor(
 		public IpAddress: string,
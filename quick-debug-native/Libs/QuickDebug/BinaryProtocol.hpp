@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Common.hpp"
+
+namespace QD {
+	/*
+	 * Compact binary wire format, used for plot samples when QuickDebugConfig::UseBinaryProtocol is enabled.
+	 * Messages are sent as binary WebSocket frames, all values are little endian.
+	 *
+	 * SeriesTable (announces the id of each series once):
+	 *   [ui8 type = 1][ui16 count] count x ([ui16 seriesId][ui8 nameLength][name bytes])
+	 *
+	 * Samples:
+	 *   [ui8 type = 2][ui16 count][f64 baseTimestampUs] count x ([ui16 seriesId][varint timestampDeltaUs][f32 value])
+	 *
+	 * Timestamps are microseconds since QuickDebug::Startup(), taken when Plot() was called.
+	 * Each timestamp is delta encoded against the previous sample of the message (the first one against baseTimestampUs).
+	 * Samples of different threads are not ordered, so deltas are signed: zigzag encoded, then written as
+	 * LEB128 varint (7 bits per byte, high bit set on all but the last byte). Deltas below 64us take a single byte.
+	 */
+	class BinaryProtocol {
+	public:
+		static const ui8 SERIES_TABLE_MESSAGE = 1;
+		static const ui8 SAMPLES_MESSAGE = 2;
+		static constexpr size_t MAX_SERIES_NAME_LENGTH = 255;
+
+		/// @brief Encodes the series table entries with ids in [first, last), names are indexed by series id
+		static std::string EncodeSeriesTable(const std::vector<std::string>& names, ui16 first, ui16 last) {
+			std::string out;
+			out.reserve(3 + (last - first) * 16);
+
+			Write(out, SERIES_TABLE_MESSAGE);
+			Write(out, static_cast<ui16>(last - first));
+			for (ui16 id = first; id < last; ++id) {
+				auto length = std::min(names[id].size(), MAX_SERIES_NAME_LENGTH);
+				Write(out, id);
+				Write(out, static_cast<ui8>(length));
+				out.append(names[id], 0, length);
+			}
+			return out;
+		}
+
+		struct Sample {
+			ui16 SeriesId;
+			ui64 TimestampUs;
+			f32 Value;
+		};
+
+		static constexpr size_t MAX_SAMPLES_PER_MESSAGE = 0xFFFF;
+
+		/// @brief Encodes up to MAX_SAMPLES_PER_MESSAGE samples into one message
+		static std::string EncodeSamples(const std::vector<Sample>& samples) {
+			std::string out;
+			EncodeSamples(samples, out);
+			return out;
+		}
+
+		/// @brief Encodes up to MAX_SAMPLES_PER_MESSAGE samples into out, reusing its capacity
+		static void EncodeSamples(const std::vector<Sample>& samples, std::string& out) {
+			auto count = std::min(samples.size(), MAX_SAMPLES_PER_MESSAGE);
+			ui64 previousTimestampUs = count > 0 ? samples[0].TimestampUs : 0;
+
+			out.clear();
+			out.reserve(3 + sizeof(f64) + count * MAX_SAMPLE_SIZE);
+
+			Write(out, SAMPLES_MESSAGE);
+			Write(out, static_cast<ui16>(count));
+			Write(out, static_cast<f64>(previousTimestampUs));
+			for (size_t i = 0; i < count; ++i) {
+				Write(out, samples[i].SeriesId);
+				WriteVarint(out, ZigZag(static_cast<i64>(samples[i].TimestampUs - previousTimestampUs)));
+				Write(out, samples[i].Value);
+				previousTimestampUs = samples[i].TimestampUs;
+			}
+		}
+
+		static std::string EncodeSample(ui16 seriesId, ui64 timestampUs, f32 value) {
+			return EncodeSamples({ Sample{ seriesId, timestampUs, value } });
+		}
+
+	private:
+		static const size_t MAX_VARINT_SIZE = 10;
+		static const size_t MAX_SAMPLE_SIZE = sizeof(ui16) + MAX_VARINT_SIZE + sizeof(f32);
+
+		// Supported targets (x86, ARM) are little endian, so values are copied as is
+		template <typename T>
+		static inline void Write(std::string& out, T value) {
+			char bytes[sizeof(T)];
+			std::memcpy(bytes, &value, sizeof(T));
+			out.append(bytes, sizeof(T));
+		}
+
+		static inline void WriteVarint(std::string& out, ui64 value) {
+			while (value >= 0x80) {
+				out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<char>(value));
+		}
+
+		// Maps signed to unsigned values so that small magnitudes stay small: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+		static inline ui64 ZigZag(i64 value) {
+			return (static_cast<ui64>(value) << 1) ^ static_cast<ui64>(value >> 63);
+		}
+	};
+}
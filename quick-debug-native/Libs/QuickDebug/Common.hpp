@@ -3,4 +3,10 @@
 #include "Common/Dbg.hpp"
 #include "Common/Types.hpp"
 #include "Common/FixedString.hpp"
+#include "Common/SmallString.hpp"
+#include "Common/BufferPool.hpp"
 #include "Common/ConcurrentQueue.hpp"
+#include "Common/EventCount.hpp"
+#include "Common/SpscRingBuffer.hpp"
+#include "Common/CopyOnWriteList.hpp"
+#include "Common/PerThreadBuffers.hpp"
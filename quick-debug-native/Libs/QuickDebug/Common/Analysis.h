@@ -8,6 +8,7 @@
 #include <cassert>
 #include "Dbg.hpp"
 #include "StrFormat.hpp"
+#include "../TraceWriter.hpp"
 
 //static char* CreateOutputString(char const* msg) {
 //	size_t needed = snprintf(NULL, 0, "%s: %s (%d)", msg, strerror(errno), errno) + 1;
@@ -241,19 +242,19 @@ namespace QD {
 	class Timer {
 	public:
 		Timer(const char* text, bool useForGroup = false) : _text(text), _useForGroup(useForGroup) {
-			_startTime = std::chrono::high_resolution_clock::now();
+			_startTime = std::chrono::steady_clock::now();
 			if (useForGroup)
 				GroupTimer::RegisterTimer(text);
 		}
 
 		Timer(const std::string& text, bool useForGroup = false) : _text(text.c_str()), _useForGroup(useForGroup) {
-			_startTime = std::chrono::high_resolution_clock::now();
+			_startTime = std::chrono::steady_clock::now();
 			if (useForGroup)
 				GroupTimer::RegisterTimer(_text);
 		}
 
 		Timer() : _text("Timer"), _useForGroup(false) {
-			_startTime = std::chrono::high_resolution_clock::now();
+			_startTime = std::chrono::steady_clock::now();
 		}
 
 		~Timer() {
@@ -261,7 +262,7 @@ namespace QD {
 		}
 
 		void Stop() {
-			auto endTime = std::chrono::high_resolution_clock::now();
+			auto endTime = std::chrono::steady_clock::now();
 
 			auto start = std::chrono::time_point_cast<std::chrono::microseconds>(_startTime).time_since_epoch();
 			auto end = std::chrono::time_point_cast<std::chrono::microseconds>(endTime).time_since_epoch();
@@ -269,6 +270,10 @@ namespace QD {
 			auto duration = end - start;
 			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
 
+			// The scope is also written as a slice of the thread's timeline while a trace is running
+			if (TraceWriter::IsWriting())
+				TraceWriter::WriteSlice(_text, "Timer", static_cast<ui64>(start.count()), static_cast<ui64>(duration.count()));
+
 			if (_useForGroup) {
 				GroupTimer::AppendTime(_text, duration.count());
 			}
@@ -282,7 +287,7 @@ namespace QD {
 		}
 
 	private:
-		std::chrono::time_point<std::chrono::high_resolution_clock> _startTime;
+		std::chrono::time_point<std::chrono::steady_clock> _startTime;	//Same clock as TraceWriter::NowUs()
 		const char* _text;
 		bool _useForGroup;
 	};
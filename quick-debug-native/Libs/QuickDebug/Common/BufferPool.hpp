@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+// Fixed number of equally sized buffers, taken and returned by any thread without locking or allocating.
+// The storage is allocated once on construction. Free buffers form a lock-free stack of indices whose top carries
+// a tag that changes on every update, so a pop can not succeed with an outdated next index (ABA).
+template <size_t BUFFER_SIZE, uint32_t BUFFER_COUNT>
+class BufferPool {
+public:
+    static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+    BufferPool() : m_storage(new char[BUFFER_SIZE * BUFFER_COUNT]), m_next(new std::atomic<uint32_t>[BUFFER_COUNT]) {
+        for (uint32_t i = 0; i < BUFFER_COUNT; ++i)
+            m_next[i].store(i + 1 < BUFFER_COUNT ? i + 1 : INVALID_INDEX, std::memory_order_relaxed);
+        m_top.store(Pack(0, 0), std::memory_order_release);
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns the index of a free buffer, INVALID_INDEX if all buffers are in use
+    uint32_t Acquire() {
+        uint64_t top = m_top.load(std::memory_order_acquire);
+        while (true) {
+            auto index = static_cast<uint32_t>(top);
+            if (index == INVALID_INDEX)
+                return INVALID_INDEX;
+
+            auto next = m_next[index].load(std::memory_order_relaxed);
+            if (m_top.compare_exchange_weak(top, Pack(next, Tag(top) + 1), std::memory_order_acquire, std::memory_order_acquire))
+                return index;
+        }
+    }
+
+    void Release(uint32_t index) {
+        uint64_t top = m_top.load(std::memory_order_relaxed);
+        do {
+            m_next[index].store(static_cast<uint32_t>(top), std::memory_order_relaxed);
+        } while (!m_top.compare_exchange_weak(top, Pack(index, Tag(top) + 1), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    char* Data(uint32_t index) {
+        return m_storage.get() + static_cast<size_t>(index) * BUFFER_SIZE;
+    }
+
+private:
+    static uint64_t Pack(uint32_t index, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+
+    static uint32_t Tag(uint64_t top) {
+        return static_cast<uint32_t>(top >> 32);
+    }
+
+    std::unique_ptr<char[]> m_storage;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_next;    // Next free buffer below each free buffer
+    std::atomic<uint64_t> m_top = 0;                    // Tag in the high, index of the first free buffer in the low bits
+};
+
+// Move-only handle of a buffer taken from a BufferPool, the buffer is returned to the pool on destruction
+template <typename Pool>
+class PooledBuffer {
+public:
+    PooledBuffer() {}
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    PooledBuffer(PooledBuffer&& other) noexcept {
+        moveFrom(other);
+    }
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~PooledBuffer() {
+        reset();
+    }
+
+    // Takes a buffer for size bytes from the pool, returns nullptr if the pool has no free buffer
+    char* acquire(Pool& pool, size_t size) {
+        reset();
+        auto index = pool.Acquire();
+        if (index == Pool::INVALID_INDEX)
+            return nullptr;
+
+        m_pool = &pool;
+        m_index = index;
+        m_size = size;
+        return pool.Data(index);
+    }
+
+    void reset() {
+        if (m_pool)
+            m_pool->Release(m_index);
+        m_pool = nullptr;
+        m_size = 0;
+    }
+
+    explicit operator bool() const {
+        return m_pool != nullptr;
+    }
+
+    std::string_view view() const {
+        return m_pool ? std::string_view(m_pool->Data(m_index), m_size) : std::string_view();
+    }
+
+private:
+    void moveFrom(PooledBuffer& other) {
+        m_pool = std::exchange(other.m_pool, nullptr);
+        m_index = other.m_index;
+        m_size = std::exchange(other.m_size, 0);
+    }
+
+    Pool* m_pool = nullptr;
+    uint32_t m_index = 0;
+    size_t m_size = 0;
+};
@@ -1,52 +1,279 @@
-#include <condition_variable> 
-#include <iostream> 
-#include <mutex> 
-#include <queue> 
-  
-// Thread-safe queue 
-template <typename T> 
-class ConcurrentQueue { 
-public: 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+// What PushBounded() does when a bounded queue is full
+enum class QueueFullPolicy {
+    Block,          // Waits until the consumer made room
+    DropNewest,     // Discards the new item
+    DropOldest      // Discards the oldest queued item that may be dropped
+};
+
+// Thread-safe queue
+// Items are stored in a ring buffer. A bounded queue (see SetCapacity) allocates its storage once,
+// an unbounded queue grows when it is full. Items are only ever moved in and out, so T may be move-only.
+// The condition variables are only signalled while a thread actually waits on them, so pushing to a queue
+// whose consumer is busy does not cost a wakeup.
+template <typename T>
+class ConcurrentQueue {
+public:
     ConcurrentQueue() {}
 
-    size_t Size() 
-    {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        return m_queue.size();
-    }
-
-    void Push(T item) 
-    { 
-        std::unique_lock<std::mutex> lock(m_mutex); 
-
-        m_queue.push(item); 
-  
-        // Notify one thread that 
-        // is waiting 
-        m_cond.notify_one(); 
-    } 
-  
-    T Pop() 
-    { 
-        std::unique_lock<std::mutex> lock(m_mutex); 
-
-        // wait until queue is not empty 
-        m_cond.wait(lock, [this]() { 
-            return !m_queue.empty(); 
-        }); 
-  
-        // retrieve item 
-        T item = m_queue.front(); 
-        m_queue.pop(); 
-  
-        // return item 
-        return item; 
-    } 
-
-
-private: 
-    std::queue<T> m_queue; 
-    std::mutex m_mutex; 
-    std::condition_variable m_cond; 
-}; 
-  
\ No newline at end of file
+    size_t Size()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    // Lock-free check that may be outdated by the time it returns, meant for spinning before a blocking pop
+    bool EmptyHint() const
+    {
+        return m_countHint.load(std::memory_order_relaxed) == 0;
+    }
+
+    // Limits the number of items accepted by PushBounded() and allocates the storage up front, 0 makes the queue unbounded.
+    // Threads blocked in PushBounded() are released when the queue becomes unbounded.
+    void SetCapacity(size_t capacity, QueueFullPolicy policy)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        m_policy = policy;
+        if (capacity > m_buffer.size())
+            Resize(capacity);
+
+        m_notFull.notify_all();
+    }
+
+    // Always queues the item, a bounded queue grows beyond its capacity if necessary
+    void Push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        PushBack(std::move(item));
+
+        // Notify one thread that
+        // is waiting
+        NotifyNotEmpty();
+    }
+
+    // Queues the item according to the capacity and policy of the queue, returns false if an item was dropped
+    bool PushBounded(T&& item)
+    {
+        return PushBounded(std::move(item), [](const T&) { return true; });
+    }
+
+    // Like PushBounded(), but DropOldest only discards queued items for which isDroppable(item) is true,
+    // e.g. to keep items queued with Push(). If there is no such item the new one is queued beyond the capacity.
+    template <typename IsDroppable>
+    bool PushBounded(T&& item, IsDroppable&& isDroppable)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        bool isDropped = false;
+        if (m_capacity > 0 && m_count >= m_capacity) {
+            switch (m_policy) {
+            case QueueFullPolicy::Block:
+                m_waitingProducers++;
+                m_notFull.wait(lock, [this]() {
+                    return m_count < m_capacity || m_capacity == 0;
+                });
+                m_waitingProducers--;
+                break;
+            case QueueFullPolicy::DropNewest:
+                m_droppedCount++;
+                return false;
+            case QueueFullPolicy::DropOldest:
+                isDropped = EraseOldest(isDroppable);
+                if (isDropped)
+                    m_droppedCount++;
+                break;
+            }
+        }
+
+        PushBack(std::move(item));
+        NotifyNotEmpty();
+        return !isDropped;
+    }
+
+    T Pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // wait until queue is not empty
+        WaitNotEmpty(lock);
+
+        // retrieve item
+        T item = PopFront();
+        NotifyNotFull();
+
+        // return item
+        return item;
+    }
+
+    // Non-blocking variant of Pop(), returns false if the queue is empty
+    bool TryPop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_count == 0)
+            return false;
+
+        item = PopFront();
+        NotifyNotFull();
+        return true;
+    }
+
+    // Waits at most for the given timeout until an item is available, returns false on timeout
+    template <typename Rep, typename Period>
+    bool TryPopFor(T& item, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!WaitNotEmptyFor(lock, timeout))
+            return false;
+
+        item = PopFront();
+        NotifyNotFull();
+        return true;
+    }
+
+    // Waits until an item is available and moves as many items as fit into the span, returns the number of items
+    size_t PopBulk(std::span<T> items)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        WaitNotEmpty(lock);
+
+        return PopFrontBulk(items);
+    }
+
+    // Like PopBulk(), but waits at most for the given timeout. Returns 0 on timeout, a zero timeout never blocks.
+    template <typename Rep, typename Period>
+    size_t PopBulkFor(std::span<T> items, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!WaitNotEmptyFor(lock, timeout))
+            return 0;
+
+        return PopFrontBulk(items);
+    }
+
+    // Number of items discarded by PushBounded() since the queue was created
+    uint64_t DroppedCount()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_droppedCount;
+    }
+
+
+private:
+    static constexpr size_t MIN_GROWTH_CAPACITY = 16;
+
+    void WaitNotEmpty(std::unique_lock<std::mutex>& lock)
+    {
+        m_waitingConsumers++;
+        m_cond.wait(lock, [this]() { return m_count > 0; });
+        m_waitingConsumers--;
+    }
+
+    template <typename Rep, typename Period>
+    bool WaitNotEmptyFor(std::unique_lock<std::mutex>& lock, std::chrono::duration<Rep, Period> timeout)
+    {
+        if (m_count > 0)
+            return true;
+        if (timeout <= timeout.zero())
+            return false;
+
+        m_waitingConsumers++;
+        bool isNotEmpty = m_cond.wait_for(lock, timeout, [this]() { return m_count > 0; });
+        m_waitingConsumers--;
+        return isNotEmpty;
+    }
+
+    // Both are called with the mutex held, so a waiting counter cannot change between the check and the wait
+    void NotifyNotEmpty()
+    {
+        if (m_waitingConsumers > 0)
+            m_cond.notify_one();
+    }
+
+    void NotifyNotFull()
+    {
+        if (m_waitingProducers > 0)
+            m_notFull.notify_one();
+    }
+
+    void PushBack(T&& item)
+    {
+        if (m_count == m_buffer.size())
+            Resize(std::max(MIN_GROWTH_CAPACITY, m_buffer.size() * 2));
+
+        m_buffer[(m_head + m_count) % m_buffer.size()] = std::move(item);
+        m_count++;
+        m_countHint.store(m_count, std::memory_order_relaxed);
+    }
+
+    T PopFront()
+    {
+        T item = std::move(m_buffer[m_head]);
+        m_head = (m_head + 1) % m_buffer.size();
+        m_count--;
+        m_countHint.store(m_count, std::memory_order_relaxed);
+        return item;
+    }
+
+    // Removes the oldest item matching the predicate, the items in front of it move up by one
+    template <typename Predicate>
+    bool EraseOldest(Predicate& predicate)
+    {
+        for (size_t i = 0; i < m_count; ++i) {
+            if (!predicate(m_buffer[(m_head + i) % m_buffer.size()]))
+                continue;
+
+            for (size_t j = i; j > 0; --j)
+                m_buffer[(m_head + j) % m_buffer.size()] = std::move(m_buffer[(m_head + j - 1) % m_buffer.size()]);
+            PopFront();
+            return true;
+        }
+        return false;
+    }
+
+    size_t PopFrontBulk(std::span<T> items)
+    {
+        size_t count = std::min(items.size(), m_count);
+        for (size_t i = 0; i < count; ++i)
+            items[i] = PopFront();
+
+        if (m_waitingProducers > 0)
+            m_notFull.notify_all();
+        return count;
+    }
+
+    void Resize(size_t size)
+    {
+        std::vector<T> buffer(size);
+        for (size_t i = 0; i < m_count; ++i)
+            buffer[i] = std::move(m_buffer[(m_head + i) % m_buffer.size()]);
+
+        m_buffer.swap(buffer);
+        m_head = 0;
+    }
+
+    std::vector<T> m_buffer;
+    size_t m_head = 0;
+    size_t m_count = 0;
+    size_t m_capacity = 0;
+    QueueFullPolicy m_policy = QueueFullPolicy::Block;
+    uint64_t m_droppedCount = 0;
+    size_t m_waitingConsumers = 0;
+    size_t m_waitingProducers = 0;
+    std::atomic<size_t> m_countHint = 0;    // Copy of m_count for EmptyHint()
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_notFull;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// List of shared items that is read far more often than it changes.
+// Readers take an immutable snapshot without locking, writers copy the list, modify the copy and publish it.
+// Items stay alive as long as a snapshot or another owner references them, so readers never see a destroyed item.
+template <typename T>
+class CopyOnWriteList {
+public:
+    using Item = std::shared_ptr<T>;
+    using Snapshot = std::shared_ptr<const std::vector<Item>>;
+
+    CopyOnWriteList() :
+        m_items(std::make_shared<const std::vector<Item>>())
+    {
+    }
+
+    CopyOnWriteList(const CopyOnWriteList&) = delete;
+    CopyOnWriteList& operator=(const CopyOnWriteList&) = delete;
+
+    Snapshot GetSnapshot() const
+    {
+        return m_items.load(std::memory_order_acquire);
+    }
+
+    void Add(Item item)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        auto items = std::make_shared<std::vector<Item>>(*m_items.load(std::memory_order_relaxed));
+        items->push_back(std::move(item));
+        m_items.store(std::move(items), std::memory_order_release);
+    }
+
+    /// Returns false if the item was not in the list
+    bool Remove(const Item& item)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        auto current = m_items.load(std::memory_order_relaxed);
+        auto items = std::make_shared<std::vector<Item>>();
+        items->reserve(current->size());
+        for (auto& existing : *current) {
+            if (existing != item)
+                items->push_back(existing);
+        }
+
+        if (items->size() == current->size())
+            return false;
+        m_items.store(std::move(items), std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return GetSnapshot()->size();
+    }
+
+private:
+    std::atomic<Snapshot> m_items;
+    std::mutex m_writeMutex;    //Serializes writers, readers never take it
+};
@@ -28,4 +28,17 @@
 #define PRINT_STRING "%s"
 #define PRINT_INT64 "%ld"
 #define PRINT_INT "%ld"
+
+#elif !defined(DEBUG_PRINT)
+
+#include <cstdio>
+#include <iostream>
+
+// Other platforms print to stdout unless the application defines its own macros
+#define DEBUG_PRINT_NOARGS(x) std::cout << x
+#define DEBUG_PRINT(x, ...) printf(x, __VA_ARGS__)
+
+#define PRINT_STRING "%s"
+#define PRINT_INT64 "%lld"
+#define PRINT_INT "%d"
 #endif
\ No newline at end of file
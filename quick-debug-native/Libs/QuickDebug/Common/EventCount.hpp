@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Lets a consumer park until producers publish new items, without a wakeup per item while the consumer is awake.
+// Consumer: key = PrepareWait(), check for items again, then Wait(key, timeout), or CancelWait() if items arrived meanwhile.
+// Producer: publish the item, then call Notify(). While no consumer is parked this is a fence and a single atomic load.
+class EventCount {
+public:
+    uint64_t PrepareWait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_epoch.load(std::memory_order_acquire);
+    }
+
+    void CancelWait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Returns false on timeout
+    template <typename Rep, typename Period>
+    bool Wait(uint64_t key, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool isNotified = m_cond.wait_for(lock, timeout, [&]() {
+            return m_epoch.load(std::memory_order_relaxed) != key;
+        });
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        return isNotified;
+    }
+
+    void Notify()
+    {
+        // Orders the publication of the item before the waiter check. Pairs with PrepareWait(): either the consumer
+        // sees the item when it checks again, or the producer sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_epoch.fetch_add(1, std::memory_order_release);
+        }
+        m_cond.notify_all();
+    }
+
+private:
+    std::atomic<uint64_t> m_epoch{ 0 };
+    std::atomic<uint32_t> m_waiters{ 0 };
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+};
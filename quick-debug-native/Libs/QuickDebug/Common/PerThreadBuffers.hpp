@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "SpscRingBuffer.hpp"
+
+// Ring buffers of many writer threads that are drained by a single reader thread.
+// Every writer thread registers its own SpscRingBuffer on first use through a thread_local Handle, so writers never share
+// a lock or a cache line. The reader only copies the list of buffers when a buffer was registered or removed, and removes
+// the buffer of an exited thread once it is drained.
+// Items that do not fit are counted by the writer, the reader reports them with TakeDroppedCount(). The counter of a buffer
+// is only written by its owning thread, the reader remembers how much of it was reported.
+template <typename T>
+class PerThreadBuffers {
+public:
+    struct Buffer {
+        SpscRingBuffer<T> Items;
+        const uint32_t Id;                          // Registration order starting at 1, e.g. to tell threads apart
+        std::atomic<bool> IsAbandoned = false;      // Set when the owning thread exits, the buffer is removed once drained
+        std::atomic<uint64_t> DroppedCount = 0;     // Only written by the owning thread
+        uint64_t ReportedDroppedCount = 0;          // Only used by the reader
+
+        Buffer(size_t capacity, uint32_t id) :
+            Items(capacity),
+            Id(id)
+        {
+        }
+
+        // Owning thread only
+        void CountDropped()
+        {
+            DroppedCount.store(DroppedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    };
+
+    // Registers a buffer for the calling thread on construction and abandons it on destruction, meant to be thread_local.
+    // The lock of the registration is only taken once per thread
+    class Handle {
+    public:
+        Handle(PerThreadBuffers& owner, size_t capacity) :
+            m_buffer(owner.Register(capacity))
+        {
+        }
+
+        ~Handle()
+        {
+            m_buffer->IsAbandoned.store(true, std::memory_order_release);
+        }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        Buffer& operator*() const
+        {
+            return *m_buffer;
+        }
+
+        Buffer* operator->() const
+        {
+            return m_buffer.get();
+        }
+
+    private:
+        std::shared_ptr<Buffer> m_buffer;
+    };
+
+    PerThreadBuffers() {}
+
+    PerThreadBuffers(const PerThreadBuffers&) = delete;
+    PerThreadBuffers& operator=(const PerThreadBuffers&) = delete;
+
+    /// Reader only: pops the items of all buffers and passes each to consume(T&), returns false if there were none
+    template <typename Consume>
+    bool Drain(Consume&& consume)
+    {
+        // Only copy the registered buffers when one was added or removed since the last call
+        auto version = m_version.load(std::memory_order_acquire);
+        if (version != m_snapshotVersion) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_snapshot = m_buffers;
+            m_snapshotVersion = version;
+        }
+
+        bool hasItems = false;
+        bool hasAbandonedBuffers = false;
+        T item;
+        for (auto& buffer : m_snapshot) {
+            // Read before draining, an abandoned buffer receives no further items
+            bool isAbandoned = buffer->IsAbandoned.load(std::memory_order_acquire);
+            while (buffer->Items.TryPop(item)) {
+                consume(item);
+                hasItems = true;
+            }
+            hasAbandonedBuffers |= isAbandoned;
+        }
+
+        if (hasAbandonedBuffers)
+            RemoveAbandonedBuffers();
+        return hasItems;
+    }
+
+    /// Reader only: lock-free check for items in any buffer or a newly registered one
+    bool HasItems() const
+    {
+        if (m_version.load(std::memory_order_acquire) != m_snapshotVersion)
+            return true;
+
+        return std::any_of(m_snapshot.begin(), m_snapshot.end(), [](const auto& buffer) {
+            return !buffer->Items.Empty();
+        });
+    }
+
+    /// Reader only: number of items dropped since the last call, including those of removed buffers
+    uint64_t TakeDroppedCount()
+    {
+        uint64_t dropped = std::exchange(m_removedDroppedCount, 0);
+        for (auto& buffer : m_snapshot) {
+            auto count = buffer->DroppedCount.load(std::memory_order_relaxed);
+            dropped += count - buffer->ReportedDroppedCount;
+            buffer->ReportedDroppedCount = count;
+        }
+        return dropped;
+    }
+
+    /// Reader only: discards the queued items and the dropped count, e.g. leftovers of a previous session
+    void Discard()
+    {
+        Drain([](T&) {});
+        TakeDroppedCount();
+    }
+
+private:
+    std::shared_ptr<Buffer> Register(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto buffer = std::make_shared<Buffer>(capacity, m_nextId++);
+        m_buffers.push_back(buffer);
+        m_version.fetch_add(1, std::memory_order_release);
+        return buffer;
+    }
+
+    void RemoveAbandonedBuffers()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::erase_if(m_buffers, [this](const auto& buffer) {
+            if (!buffer->IsAbandoned.load(std::memory_order_acquire) || !buffer->Items.Empty())
+                return false;
+
+            // The owning thread exited, so the count is final
+            m_removedDroppedCount += buffer->DroppedCount.load(std::memory_order_relaxed) - buffer->ReportedDroppedCount;
+            return true;
+        });
+        m_snapshot = m_buffers;
+        m_snapshotVersion = m_version.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    std::mutex m_mutex;                                 // Only taken when a thread registers and when buffers are removed
+    std::vector<std::shared_ptr<Buffer>> m_buffers;
+    std::atomic<uint64_t> m_version = 0;                // Changed whenever m_buffers changes
+    uint32_t m_nextId = 1;
+
+    std::vector<std::shared_ptr<Buffer>> m_snapshot;    // Reader only
+    uint64_t m_snapshotVersion = 0;                     // Reader only
+    uint64_t m_removedDroppedCount = 0;                 // Reader only, unreported drops of removed buffers
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+// Move-only string with inline storage, only strings longer than INLINE_SIZE are allocated on the heap
+template<size_t INLINE_SIZE>
+class SmallString {
+public:
+    SmallString() {
+        m_inline[0] = '\0';
+    }
+
+    SmallString(std::string_view str) {
+        assign(str);
+    }
+
+    SmallString(const SmallString&) = delete;
+    SmallString& operator=(const SmallString&) = delete;
+
+    SmallString(SmallString&& other) noexcept {
+        moveFrom(other);
+    }
+
+    SmallString& operator=(SmallString&& other) noexcept {
+        if (this != &other)
+            moveFrom(other);
+        return *this;
+    }
+
+    SmallString& operator=(std::string_view str) {
+        assign(str);
+        return *this;
+    }
+
+    const char* c_str() const {
+        return m_heap ? m_heap.get() : m_inline;
+    }
+
+    size_t length() const {
+        return m_length;
+    }
+
+    bool empty() const {
+        return m_length == 0;
+    }
+
+    // Replaces the content with length uninitialized chars and returns them for writing
+    char* assign_uninitialized(size_t length) {
+        char* target = m_inline;
+        if (length > INLINE_SIZE) {
+            m_heap.reset(new char[length + 1]);
+            target = m_heap.get();
+        }
+        else {
+            m_heap.reset();
+        }
+
+        target[length] = '\0';
+        m_length = length;
+        return target;
+    }
+
+    std::string_view view() const {
+        return std::string_view(c_str(), m_length);
+    }
+
+    // Implicit conversion to std::string_view
+    operator std::string_view() const {
+        return view();
+    }
+
+private:
+    char m_inline[INLINE_SIZE + 1];  // +1 for the null terminator
+    std::unique_ptr<char[]> m_heap;
+    size_t m_length = 0;
+
+    void assign(std::string_view str) {
+        std::memcpy(assign_uninitialized(str.size()), str.data(), str.size());
+    }
+
+    void moveFrom(SmallString& other) {
+        m_heap = std::move(other.m_heap);
+        m_length = other.m_length;
+        if (!m_heap)
+            std::memcpy(m_inline, other.m_inline, m_length + 1);
+
+        other.m_inline[0] = '\0';
+        other.m_length = 0;
+    }
+};
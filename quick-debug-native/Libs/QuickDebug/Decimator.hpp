@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Common.hpp"
+
+namespace QD {
+	/// @brief How the samples of a bucket are reduced
+	enum class DecimationMode : i32 {
+		Last = 0,		//Last sample of the bucket
+		Mean = 1,		//Average value at the average timestamp
+		MinMax = 2,		//Minimum and maximum in their original order, keeps spikes visible (two points per bucket)
+		Lttb = 3,		//Largest-Triangle-Three-Buckets: the sample spanning the largest triangle with the neighbouring buckets.
+						//Needs the following bucket, so points are delayed by one bucket
+	};
+
+	/*
+	 * Reduces the samples of one series to a target number of points per second.
+	 * Time is split into aligned buckets of equal length. A bucket is reduced and emitted when a sample of a later
+	 * bucket arrives or Flush() is called, emitted points are passed to a callback taking (ui64 timestampUs, f32 value).
+	 */
+	class SeriesDecimator {
+	public:
+		/// @brief Length of a bucket for the given target rate, MinMax buckets are twice as long since they emit two points
+		static ui64 GetBucketLengthUs(ui32 pointsPerSecond, DecimationMode mode) {
+			ui64 pointsPerBucket = mode == DecimationMode::MinMax ? 2 : 1;
+			return std::max<ui64>(1, 1000000 * pointsPerBucket / std::max<ui32>(1, pointsPerSecond));
+		}
+
+		template <typename Emit>
+		void Add(ui64 timestampUs, f32 value, DecimationMode mode, ui64 bucketLengthUs, Emit&& emit) {
+			if (m_count > 0 && timestampUs >= m_bucketStartUs + bucketLengthUs)
+				CloseBucket(mode, emit);
+
+			if (m_count == 0) {
+				m_bucketStartUs = timestampUs - timestampUs % bucketLengthUs;
+				m_sum = 0;
+				m_timestampSum = 0;
+				m_min = { timestampUs, value };
+				m_max = { timestampUs, value };
+			}
+
+			// Samples of other threads may be slightly older than the bucket, they are counted to the open bucket
+			m_count++;
+			m_sum += value;
+			m_timestampSum += static_cast<f64>(timestampUs);
+			m_last = { timestampUs, value };
+			if (value < m_min.Value)
+				m_min = m_last;
+			if (value > m_max.Value)
+				m_max = m_last;
+			if (mode == DecimationMode::Lttb)
+				m_bucketPoints.push_back(m_last);
+		}
+
+		/// @brief Emits all buffered points, used when the series was idle or the settings change
+		template <typename Emit>
+		void Flush(DecimationMode mode, Emit&& emit) {
+			if (m_count > 0)
+				CloseBucket(mode, emit);
+
+			// The last LTTB bucket has no following bucket, its last point is the best estimate
+			if (!m_previousBucketPoints.empty()) {
+				EmitPoint(m_previousBucketPoints.back(), emit);
+				m_previousBucketPoints.clear();
+			}
+			m_hasSelected = false;
+		}
+
+		bool HasOpenBucket() const {
+			return m_count > 0 || !m_previousBucketPoints.empty();
+		}
+
+		/// @brief End of the open bucket, 0 if there is none
+		ui64 GetBucketEndUs(ui64 bucketLengthUs) const {
+			return m_count > 0 ? m_bucketStartUs + bucketLengthUs : 0;
+		}
+
+	private:
+		struct Point {
+			ui64 TimestampUs;
+			f32 Value;
+		};
+
+		template <typename Emit>
+		void CloseBucket(DecimationMode mode, Emit& emit) {
+			switch (mode) {
+			case DecimationMode::Last:
+				EmitPoint(m_last, emit);
+				break;
+			case DecimationMode::Mean:
+				EmitPoint({ static_cast<ui64>(m_timestampSum / m_count), static_cast<f32>(m_sum / m_count) }, emit);
+				break;
+			case DecimationMode::MinMax:
+			{
+				bool isMinFirst = m_min.TimestampUs <= m_max.TimestampUs;
+				EmitPoint(isMinFirst ? m_min : m_max, emit);
+				if (m_min.TimestampUs != m_max.TimestampUs || m_min.Value != m_max.Value)
+					EmitPoint(isMinFirst ? m_max : m_min, emit);
+				break;
+			}
+			case DecimationMode::Lttb:
+				SelectLttbPoint(emit);
+				break;
+			}
+			m_count = 0;
+		}
+
+		// Selects the point of the previous bucket, which forms the largest triangle with the last selected point
+		// and the average of the bucket that is closed now
+		template <typename Emit>
+		void SelectLttbPoint(Emit& emit) {
+			if (!m_previousBucketPoints.empty()) {
+				f64 nextTimestamp = m_timestampSum / m_count;
+				f64 nextValue = m_sum / m_count;
+
+				if (!m_hasSelected) {
+					// The first point of a series is always kept
+					EmitPoint(m_previousBucketPoints.front(), emit);
+				}
+
+				const Point* best = &m_previousBucketPoints.front();
+				f64 bestArea = -1;
+				for (const auto& point : m_previousBucketPoints) {
+					f64 area = std::abs(
+						(static_cast<f64>(m_selected.TimestampUs) - nextTimestamp) * (static_cast<f64>(point.Value) - m_selected.Value) -
+						(static_cast<f64>(m_selected.TimestampUs) - static_cast<f64>(point.TimestampUs)) * (nextValue - m_selected.Value));
+					if (area > bestArea) {
+						bestArea = area;
+						best = &point;
+					}
+				}
+
+				if (best->TimestampUs != m_selected.TimestampUs || best->Value != m_selected.Value)
+					EmitPoint(*best, emit);
+			}
+
+			m_previousBucketPoints.swap(m_bucketPoints);
+			m_bucketPoints.clear();
+		}
+
+		template <typename Emit>
+		void EmitPoint(const Point& point, Emit& emit) {
+			m_selected = point;
+			m_hasSelected = true;
+			emit(point.TimestampUs, point.Value);
+		}
+
+		// Open bucket
+		ui64 m_bucketStartUs = 0;
+		ui32 m_count = 0;
+		f64 m_sum = 0;
+		f64 m_timestampSum = 0;
+		Point m_min{};
+		Point m_max{};
+		Point m_last{};
+
+		// LTTB only
+		std::vector<Point> m_bucketPoints;
+		std::vector<Point> m_previousBucketPoints;
+
+		Point m_selected{};		//Last emitted point
+		bool m_hasSelected = false;
+	};
+}
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ext {
+    // Raw DEFLATE (RFC 1951) as used by the WebSocket permessage-deflate extension (RFC 7692).
+    // Every message is compressed on its own (no context takeover), so one compressed frame can be shared by all clients.
+
+    // LZ77 with hash chains and the fixed Huffman code. The output ends with a sync flush whose trailing
+    // 00 00 FF FF is removed, as required by permessage-deflate. Buffers are reused between messages.
+    class Deflater {
+    public:
+        static constexpr int MIN_LEVEL = 1;
+        static constexpr int MAX_LEVEL = 9;
+        static constexpr int MIN_WINDOW_BITS = 9;
+        static constexpr int MAX_WINDOW_BITS = 15;
+
+        // level trades speed for ratio (length of the searched hash chains), windowBits limits the match distance
+        explicit Deflater(int level = 6, int windowBits = MAX_WINDOW_BITS) {
+            Configure(level, windowBits);
+        }
+
+        void Configure(int level, int windowBits) {
+            static const int chainLengths[MAX_LEVEL + 1] = { 0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096 };
+            m_maxChainLength = chainLengths[std::clamp(level, MIN_LEVEL, MAX_LEVEL)];
+            m_windowSize = size_t(1) << std::clamp(windowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS);
+            m_previous.assign(m_windowSize, 0);
+            m_head.assign(HASH_SIZE, 0);
+            m_base = 1;
+        }
+
+        // Replaces out with the compressed message
+        void Compress(std::string_view input, std::string& out) {
+            out.clear();
+            out.reserve(input.size() / 2 + 16);
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+
+            // Positions of earlier messages are below m_base and thereby invalid, which saves clearing the tables
+            if (m_base > UINT32_MAX / 2 - input.size()) {
+                std::fill(m_head.begin(), m_head.end(), 0);
+                m_base = 1;
+            }
+
+            WriteBits(out, 0, 1);   //BFINAL
+            WriteBits(out, 1, 2);   //BTYPE fixed Huffman
+
+            const auto* data = reinterpret_cast<const unsigned char*>(input.data());
+            size_t size = input.size();
+            size_t i = 0;
+            while (i < size) {
+                size_t matchLength = 0;
+                size_t matchDistance = 0;
+                if (i + MIN_MATCH <= size)
+                    FindMatch(data, size, i, matchLength, matchDistance);
+
+                if (matchLength >= MIN_MATCH) {
+                    WriteLength(out, matchLength);
+                    WriteDistance(out, matchDistance);
+
+                    // FindMatch() inserted the start of the match already
+                    size_t end = i + matchLength;
+                    for (++i; i < end; ++i) {
+                        if (i + MIN_MATCH <= size)
+                            Insert(data, i);
+                    }
+                }
+                else {
+                    WriteLiteral(out, data[i]);
+                    ++i;
+                }
+            }
+
+            WriteLiteral(out, END_OF_BLOCK);
+
+            // Sync flush: empty stored block, of which only the 3 header bits remain after removing 00 00 FF FF
+            WriteBits(out, 0, 3);
+            if (m_bitCount > 0)
+                out.push_back(static_cast<char>(m_bitBuffer));
+
+            m_base += static_cast<uint32_t>(size);
+        }
+
+    private:
+        static const size_t MIN_MATCH = 3;
+        static constexpr size_t MAX_MATCH = 258;
+        static const size_t HASH_BITS = 15;
+        static const size_t HASH_SIZE = size_t(1) << HASH_BITS;
+        static const uint32_t END_OF_BLOCK = 256;
+
+        static uint32_t Hash(const unsigned char* data) {
+            uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+            return (value * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        void Insert(const unsigned char* data, size_t i) {
+            auto position = m_base + static_cast<uint32_t>(i);
+            auto& head = m_head[Hash(data + i)];
+            m_previous[position & (m_windowSize - 1)] = head;
+            head = position;
+        }
+
+        void FindMatch(const unsigned char* data, size_t size, size_t i, size_t& bestLength, size_t& bestDistance) {
+            auto position = m_base + static_cast<uint32_t>(i);
+            auto candidate = m_head[Hash(data + i)];
+            size_t maxLength = std::min(MAX_MATCH, size - i);
+
+            for (int chain = 0; chain < m_maxChainLength; ++chain) {
+                if (candidate < m_base || candidate >= position || position - candidate > m_windowSize - 1)
+                    break;
+
+                const unsigned char* match = data + (candidate - m_base);
+                if (match[bestLength] == data[i + bestLength] || bestLength == 0) {
+                    size_t length = 0;
+                    while (length < maxLength && match[length] == data[i + length])
+                        ++length;
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = position - candidate;
+                        if (length == maxLength)
+                            break;
+                    }
+                }
+                candidate = m_previous[candidate & (m_windowSize - 1)];
+            }
+
+            Insert(data, i);
+        }
+
+        void WriteBits(std::string& out, uint32_t value, int count) {
+            m_bitBuffer |= static_cast<uint64_t>(value) << m_bitCount;
+            m_bitCount += count;
+            while (m_bitCount >= 8) {
+                out.push_back(static_cast<char>(m_bitBuffer & 0xFF));
+                m_bitBuffer >>= 8;
+                m_bitCount -= 8;
+            }
+        }
+
+        // Huffman codes are stored most significant bit first
+        void WriteCode(std::string& out, uint32_t code, int length) {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; ++i)
+                reversed |= ((code >> i) & 1) << (length - 1 - i);
+            WriteBits(out, reversed, length);
+        }
+
+        void WriteLiteral(std::string& out, uint32_t symbol) {
+            if (symbol < 144)
+                WriteCode(out, 0x30 + symbol, 8);
+            else if (symbol < 256)
+                WriteCode(out, 0x190 + symbol - 144, 9);
+            else if (symbol < 280)
+                WriteCode(out, symbol - 256, 7);
+            else
+                WriteCode(out, 0xC0 + symbol - 280, 8);
+        }
+
+        void WriteLength(std::string& out, size_t length) {
+            int code = 0;
+            while (code < 28 && LENGTH_BASE[code + 1] <= length)
+                ++code;
+            WriteLiteral(out, 257 + code);
+            WriteBits(out, static_cast<uint32_t>(length - LENGTH_BASE[code]), LENGTH_EXTRA_BITS[code]);
+        }
+
+        void WriteDistance(std::string& out, size_t distance) {
+            int code = 0;
+            while (code < 29 && DISTANCE_BASE[code + 1] <= distance)
+                ++code;
+            WriteCode(out, code, 5);
+            WriteBits(out, static_cast<uint32_t>(distance - DISTANCE_BASE[code]), DISTANCE_EXTRA_BITS[code]);
+        }
+
+    public:
+        static constexpr uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static constexpr uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static constexpr uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static constexpr uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    private:
+        int m_maxChainLength = 0;
+        size_t m_windowSize = 0;
+        std::vector<uint32_t> m_head;       //Latest position of each hash
+        std::vector<uint32_t> m_previous;   //Previous position with the same hash, indexed by position within the window
+        uint32_t m_base = 1;                //Position of the first byte of the current message
+
+        uint64_t m_bitBuffer = 0;
+        int m_bitCount = 0;
+    };
+
+    // Decompresses messages of clients that use permessage-deflate without context takeover (stored, fixed and dynamic blocks)
+    class Inflater {
+    public:
+        // Replaces out with the decompressed message, returns false if the data is invalid or exceeds maxSize
+        bool Inflate(std::string_view input, std::string& out, size_t maxSize) {
+            // permessage-deflate removes the trailing 00 00 FF FF of the sync flush
+            m_input.assign(input.begin(), input.end());
+            m_input.insert(m_input.end(), { '\0', '\0', '\xFF', '\xFF' });
+            m_position = 0;
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+            m_isValid = true;
+            out.clear();
+
+            bool isFinal = false;
+            while (!isFinal && m_position < m_input.size()) {
+                isFinal = ReadBits(1) == 1;
+                switch (ReadBits(2)) {
+                case 0: InflateStored(out, maxSize); break;
+                case 1: InflateFixed(out, maxSize); break;
+                case 2: InflateDynamic(out, maxSize); break;
+                default: m_isValid = false; break;
+                }
+                if (!m_isValid)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        static const int MAX_CODE_LENGTH = 15;
+
+        // Canonical Huffman code, decoded one bit at a time
+        struct Huffman {
+            uint16_t Counts[MAX_CODE_LENGTH + 1];
+            uint16_t Symbols[288];
+
+            void Build(const uint8_t* lengths, int count) {
+                std::fill(std::begin(Counts), std::end(Counts), 0);
+                for (int i = 0; i < count; ++i)
+                    Counts[lengths[i]]++;
+                Counts[0] = 0;
+
+                uint16_t offsets[MAX_CODE_LENGTH + 2] = { 0 };
+                for (int length = 1; length <= MAX_CODE_LENGTH; ++length)
+                    offsets[length + 1] = offsets[length] + Counts[length];
+                for (int i = 0; i < count; ++i) {
+                    if (lengths[i] != 0)
+                        Symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+                }
+            }
+        };
+
+        uint32_t ReadBits(int count) {
+            while (m_bitCount < count) {
+                if (m_position >= m_input.size()) {
+                    m_isValid = false;
+                    return 0;
+                }
+                m_bitBuffer |= static_cast<uint32_t>(static_cast<unsigned char>(m_input[m_position++])) << m_bitCount;
+                m_bitCount += 8;
+            }
+            uint32_t value = m_bitBuffer & ((uint64_t(1) << count) - 1);
+            m_bitBuffer >>= count;
+            m_bitCount -= count;
+            return value;
+        }
+
+        int Decode(const Huffman& huffman) {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+                code |= static_cast<int>(ReadBits(1));
+                int count = huffman.Counts[length];
+                if (code - first < count)
+                    return huffman.Symbols[index + code - first];
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+                if (!m_isValid)
+                    return -1;
+            }
+            m_isValid = false;
+            return -1;
+        }
+
+        void InflateStored(std::string& out, size_t maxSize) {
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+            if (m_position + 4 > m_input.size()) {
+                m_isValid = false;
+                return;
+            }
+
+            auto* header = reinterpret_cast<const unsigned char*>(m_input.data() + m_position);
+            uint32_t length = header[0] | (header[1] << 8);
+            uint32_t inverted = header[2] | (header[3] << 8);
+            m_position += 4;
+            if ((length ^ 0xFFFF) != inverted || m_position + length > m_input.size() || out.size() + length > maxSize) {
+                m_isValid = false;
+                return;
+            }
+
+            out.append(m_input.data() + m_position, length);
+            m_position += length;
+        }
+
+        void InflateFixed(std::string& out, size_t maxSize) {
+            if (!m_hasFixedCodes) {
+                uint8_t lengths[288];
+                std::fill(lengths, lengths + 144, uint8_t(8));
+                std::fill(lengths + 144, lengths + 256, uint8_t(9));
+                std::fill(lengths + 256, lengths + 280, uint8_t(7));
+                std::fill(lengths + 280, lengths + 288, uint8_t(8));
+                m_fixedLiterals.Build(lengths, 288);
+                std::fill(lengths, lengths + 30, uint8_t(5));
+                m_fixedDistances.Build(lengths, 30);
+                m_hasFixedCodes = true;
+            }
+            InflateCodes(out, maxSize, m_fixedLiterals, m_fixedDistances);
+        }
+
+        void InflateDynamic(std::string& out, size_t maxSize) {
+            static const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            int literalCount = static_cast<int>(ReadBits(5)) + 257;
+            int distanceCount = static_cast<int>(ReadBits(5)) + 1;
+            int codeLengthCount = static_cast<int>(ReadBits(4)) + 4;
+            if (!m_isValid || literalCount > 286 || distanceCount > 30) {
+                m_isValid = false;
+                return;
+            }
+
+            uint8_t lengths[320] = { 0 };
+            for (int i = 0; i < codeLengthCount; ++i)
+                lengths[codeLengthOrder[i]] = static_cast<uint8_t>(ReadBits(3));
+
+            Huffman codeLengths;
+            codeLengths.Build(lengths, 19);
+
+            std::fill(std::begin(lengths), std::end(lengths), uint8_t(0));
+            int index = 0;
+            while (m_isValid && index < literalCount + distanceCount) {
+                int symbol = Decode(codeLengths);
+                if (symbol < 0)
+                    return;
+                if (symbol < 16) {
+                    lengths[index++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+
+                uint8_t length = 0;
+                int repeat;
+                if (symbol == 16) {
+                    if (index == 0) {
+                        m_isValid = false;
+                        return;
+                    }
+                    length = lengths[index - 1];
+                    repeat = 3 + static_cast<int>(ReadBits(2));
+                }
+                else if (symbol == 17)
+                    repeat = 3 + static_cast<int>(ReadBits(3));
+                else
+                    repeat = 11 + static_cast<int>(ReadBits(7));
+
+                if (index + repeat > literalCount + distanceCount) {
+                    m_isValid = false;
+                    return;
+                }
+                while (repeat-- > 0)
+                    lengths[index++] = length;
+            }
+            if (!m_isValid)
+                return;
+
+            Huffman literals;
+            Huffman distances;
+            literals.Build(lengths, literalCount);
+            distances.Build(lengths + literalCount, distanceCount);
+            InflateCodes(out, maxSize, literals, distances);
+        }
+
+        void InflateCodes(std::string& out, size_t maxSize, const Huffman& literals, const Huffman& distances) {
+            while (m_isValid) {
+                int symbol = Decode(literals);
+                if (symbol < 0 || symbol == 256)
+                    return;
+
+                if (symbol < 256) {
+                    if (out.size() >= maxSize) {
+                        m_isValid = false;
+                        return;
+                    }
+                    out.push_back(static_cast<char>(symbol));
+                    continue;
+                }
+
+                symbol -= 257;
+                if (symbol >= 29) {
+                    m_isValid = false;
+                    return;
+                }
+                size_t length = Deflater::LENGTH_BASE[symbol] + ReadBits(Deflater::LENGTH_EXTRA_BITS[symbol]);
+
+                int distanceSymbol = Decode(distances);
+                if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                    m_isValid = false;
+                    return;
+                }
+                size_t distance = Deflater::DISTANCE_BASE[distanceSymbol] + ReadBits(Deflater::DISTANCE_EXTRA_BITS[distanceSymbol]);
+                if (!m_isValid || distance > out.size() || out.size() + length > maxSize) {
+                    m_isValid = false;
+                    return;
+                }
+
+                // Byte by byte, since the match may overlap the bytes it produces
+                size_t start = out.size() - distance;
+                for (size_t i = 0; i < length; ++i)
+                    out.push_back(out[start + i]);
+            }
+        }
+
+        std::string m_input;
+        size_t m_position = 0;
+        uint32_t m_bitBuffer = 0;
+        int m_bitCount = 0;
+        bool m_isValid = true;
+
+        bool m_hasFixedCodes = false;
+        Huffman m_fixedLiterals;
+        Huffman m_fixedDistances;
+    };
+}
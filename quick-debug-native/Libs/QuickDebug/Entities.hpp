@@ -1,13 +1,83 @@
 ﻿#pragma once
+#include <algorithm>
 #include <map>
 #include <string>
+#include <charconv>
+#include <cstring>
 #include <ranges>
+#include <span>
+#include "Decimator.hpp"
+#include "SeriesFilter.hpp"
+#include "SeriesRegistry.hpp"
+#include "WebSocketServer.hpp"
 
 
 namespace QD {
     struct QuickDebugConfig {
         bool UseWebserver = false;
         ui16 WebsocketPort = 8126;
+
+        //Multi-producer mode: every thread calling Plot() writes into its own lock-free ring buffer,
+        //which is drained by the publisher thread. Plot() never takes a lock in this mode.
+        bool UsePerThreadQueues = false;
+        //Capacity of each per-thread ring buffer, PlotQueuePolicy applies when it is full
+        ui32 PerThreadQueueCapacity = 4096;
+
+        //Maximum number of samples in the shared plot queue, 0 = unbounded. The queue is allocated by Startup()
+        ui32 PlotQueueCapacity = 0;
+        //What Plot() does when the queue is full. The per-thread ring buffers can only be emptied by the publisher,
+        //so DropOldest behaves like DropNewest there. The number of dropped samples is plotted as "QD/DroppedSamples"
+        QueueFullPolicy PlotQueuePolicy = QueueFullPolicy::DropNewest;
+
+        //Number of times the publisher polls the empty queues (yielding the CPU in between) before it parks.
+        //Producers only wake the publisher while it is parked, so spinning saves wakeups for bursty producers
+        ui32 PublisherSpinCount = 64;
+        //Longest time the parked publisher sleeps before it runs its periodic work (dropped sample reports, TSC calibration).
+        //New samples, pending batches and decimation buckets wake it earlier
+        ui32 PublisherFlushPeriodUs = 10000;
+
+        //Sends plot samples as compact binary frames (see BinaryProtocol.hpp) instead of "1;graph;value;timestampUs" text messages
+        bool UseBinaryProtocol = false;
+
+        //Timestamps samples with the CPU time stamp counter (rdtsc) instead of std::chrono::steady_clock, if the CPU has an invariant TSC.
+        //The TSC frequency is calibrated against steady_clock once per second
+        bool UseTscClock = false;
+
+        //Packs the samples of a time window into one WebSocket frame per client to reduce the number of send() calls
+        bool UseBatching = false;
+        //How long the publisher keeps collecting samples after the first sample of a batch arrived
+        ui32 BatchWindowUs = 1000;
+        //A batch is sent as soon as it holds this many samples
+        ui32 BatchMaxSamples = 256;
+        //Upper bound for the time between Plot() and the transmission of a sample, 0 disables the bound
+        ui32 BatchMaxLatencyUs = 0;
+
+        //Reduces every series to about this many points per second before it is sent, 0 sends every sample.
+        //Clients can change both values at runtime through the keys "QD/PointsPerSecond" and "QD/DecimationMode" (see DecimationMode)
+        ui32 DecimationPointsPerSecond = 0;
+        DecimationMode Decimation = DecimationMode::MinMax;
+
+        //Sets TCP_NODELAY on client sockets, so small frames are not delayed by Nagle's algorithm
+        bool TcpNoDelay = false;
+        //Coalesces bursts of queued frames into full TCP segments (MSG_MORE, Linux only)
+        bool TcpCork = false;
+
+        //Threads the WebSocket connections are distributed across (Linux epoll backend only). More than one helps when
+        //many dashboards are connected, every thread writes the shared broadcast frames to its own clients
+        ui32 IoThreadCount = 1;
+
+        //Maximum bytes queued per client, 0 = unbounded. Plot samples of clients above the limit are handled by SlowClientPolicy,
+        //control messages (configuration, series table) are always delivered
+        ui32 MaxClientOutboundBytes = 4 * 1024 * 1024;
+        Ext::WebSocketServer::SlowClientPolicy SlowClientPolicy = Ext::WebSocketServer::SlowClientPolicy::DropOldest;
+
+        //Compresses broadcast messages with permessage-deflate for clients that offer it (all current browsers do).
+        //Saves bandwidth on remote connections at the cost of publisher CPU time, messages are compressed once for all clients.
+        //Requires UseBatching: without context takeover every message is compressed on its own, so only the large messages
+        //of a batch compress well, single samples are shorter than the minimum compressed size. Ignored without batching
+        bool UseCompression = false;
+        i32 CompressionLevel = 6;           //1 (fastest) - 9 (smallest)
+        i32 CompressionWindowBits = 15;     //9 - 15, smaller windows use less memory but find fewer matches
     };
 
     struct RecvMessageConfig
@@ -25,28 +95,194 @@ namespace QD {
         }
     };
 
-    const struct TransmissionMsg
+    enum class TransmissionMsgType : ui8
+    {
+        Text = 0,           //"message" holds a ready to send text message
+        Sample = 1,         //"seriesId" or, if not registered, "message" identifies the graph, the wire encoding is chosen by the publisher
+        SeriesTable = 2,    //Requests the publisher to announce all known series (binary protocol only)
+        SampleBlock = 3,    //Consecutive values of "seriesId" packed as f32 in "message", "value" is the interval between them in microseconds
+        SampleFrame = 4,    //One value per series taken at the same time, packed as {ui16 seriesId, f32 value} in "message"
+        SeriesPrecision = 5,//Sets the text protocol decimals of "seriesId" to "precision"
+        Subscription = 6,   //"subscriptionAction" of the client "subscriber", "message" holds the ';' separated series names
+    };
+
+    // Move-only, graph names of plot samples are stored inline so that queueing a sample does not allocate
+    struct TransmissionMsg
     {
-        std::string message;
+        static const size_t INLINE_MESSAGE_SIZE = 47;   //Longer names and control messages are allocated on the heap
+        static const size_t POOLED_PAYLOAD_SIZE = 4096; //Longer blocks and frames than this are allocated on the heap
+        static const ui32 PAYLOAD_POOL_SIZE = 128;      //Blocks and frames in flight, more are allocated on the heap
+        using PayloadPool = BufferPool<POOLED_PAYLOAD_SIZE, PAYLOAD_POOL_SIZE>;
+
+        SmallString<INLINE_MESSAGE_SIZE> message;
+        PooledBuffer<PayloadPool> pooledPayload;        //Holds blocks and frames instead of "message" if they do not fit inline
+        TransmissionMsgType type = TransmissionMsgType::Text;
+        ui16 seriesId = SeriesHandle::INVALID_ID;
+        // Control messages have typed members that share the storage of the sample fields, so they do not make
+        // the queued message larger. "type" tells which member is set
+        union {
+            f32 value = 0;
+            i32 precision;                          //SeriesPrecision
+            SubscriptionAction subscriptionAction;  //Subscription
+        };
+        union {
+            ui64 timestamp = 0;     //SampleClock ticks, taken when Plot() was called
+            SOCKET subscriber;      //Subscription
+        };
+
+        /// @brief Values of a block or the entries of a frame
+        std::string_view Payload() const
+        {
+            return pooledPayload ? pooledPayload.view() : message.view();
+        }
 
-        static TransmissionMsg CreatePlotMessage(const char* graph, const float value)
+        static TransmissionMsg CreatePlotSample(const char* graph, const float value, const ui64 timestamp)
         {
             TransmissionMsg x;
+            x.type = TransmissionMsgType::Sample;
+            x.message = graph;
+            x.value = value;
+            x.timestamp = timestamp;
+            return x;
+        }
+
+        static TransmissionMsg CreatePlotSample(const SeriesHandle series, const float value, const ui64 timestamp)
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::Sample;
+            x.seriesId = series.Id;
+            x.value = value;
+            x.timestamp = timestamp;
+            return x;
+        }
+
+        /// @brief A block of values of one series, the last value is taken at timestamp and the others sampleIntervalUs apart before it
+        static TransmissionMsg CreatePlotBlock(const SeriesHandle series, std::span<const f32> values, const f32 sampleIntervalUs, const ui64 timestamp)
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::SampleBlock;
+            x.seriesId = series.Id;
+            std::memcpy(x.AssignPayload(values.size_bytes()), values.data(), values.size_bytes());
+            x.value = sampleIntervalUs;
+            x.timestamp = timestamp;
+            return x;
+        }
 
-            const char* messageType = "1";
-            constexpr size_t graphSize = sizeof(graph) - 1;  //-1 removes the null terminator
-            x.message.reserve(1 + 1 + graphSize + 1 + std::to_string(value).size());
+        /// @brief One value per series, values[i] belongs to series[i]. Invalid handles are skipped
+        static TransmissionMsg CreatePlotFrame(std::span<const SeriesHandle> series, std::span<const f32> values, const ui64 timestamp)
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::SampleFrame;
+            x.timestamp = timestamp;
 
-            x.message.append(messageType);
-            x.message.append(";");
-            x.message.append(graph);
-            x.message.append(";");
-            x.message.append(std::to_string(value));
+            auto count = std::min(series.size(), values.size());
+            size_t validCount = 0;
+            for (size_t i = 0; i < count; ++i)
+                validCount += series[i].IsValid() ? 1 : 0;
 
+            char* target = x.AssignPayload(validCount * FRAME_ENTRY_SIZE);
+            for (size_t i = 0; i < count; ++i) {
+                if (!series[i].IsValid())
+                    continue;
+                std::memcpy(target, &series[i].Id, sizeof(ui16));
+                std::memcpy(target + sizeof(ui16), &values[i], sizeof(f32));
+                target += FRAME_ENTRY_SIZE;
+            }
             return x;
         }
 
-        static TransmissionMsg CreateConfigurationVariableMessage(const std::map<std::string, RecvMessageConfig>& variables)
+        static const size_t FRAME_ENTRY_SIZE = sizeof(ui16) + sizeof(f32);
+
+        /// @brief Space for the payload of a block or frame. Payloads that do not fit inline are written into a buffer of the
+        /// payload pool, so plotting them does not allocate. The pool is allocated on first use and falls back to the heap when exhausted
+        char* AssignPayload(size_t length)
+        {
+            static PayloadPool& pool = *new PayloadPool();  //Never destroyed, queued messages may outlive other statics
+            if (length > INLINE_MESSAGE_SIZE && length <= POOLED_PAYLOAD_SIZE) {
+                if (char* target = pooledPayload.acquire(pool, length)) {
+                    message = std::string_view();
+                    return target;
+                }
+            }
+            pooledPayload.reset();
+            return message.assign_uninitialized(length);
+        }
+
+        static TransmissionMsg CreateSeriesPrecisionMessage(const SeriesHandle series, const i32 decimals)
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::SeriesPrecision;
+            x.seriesId = series.Id;
+            x.precision = decimals;
+            return x;
+        }
+
+        static TransmissionMsg CreateSubscriptionMessage(const SOCKET client, const SubscriptionAction action, std::string_view seriesNames = {})
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::Subscription;
+            x.message = seriesNames;
+            x.subscriptionAction = action;
+            x.subscriber = client;
+            return x;
+        }
+
+        static TransmissionMsg CreateSeriesTableRequest()
+        {
+            TransmissionMsg x;
+            x.type = TransmissionMsgType::SeriesTable;
+            return x;
+        }
+
+        static TransmissionMsg CreatePlotMessage(std::string_view graph, const float value, const ui64 timestampUs)
+        {
+            TransmissionMsg x;
+
+            std::string message;
+            AppendPlotMessage(message, graph, value, timestampUs);
+            x.message = message;
+
+            return x;
+        }
+
+        static constexpr i32 SHORTEST_PRECISION = -1;     //Shortest text that reads back as the same float
+        static constexpr i32 MAX_PRECISION = 9;           //More decimals than a float can hold
+
+        /// @brief Appends the text protocol message "1;graph;value;timestampUs" to out.
+        /// Numbers are formatted with std::to_chars directly into out, so there are no temporary strings and no locale lookups
+        static void AppendPlotMessage(std::string& out, std::string_view graph, const float value, const ui64 timestampUs, const i32 precision = SHORTEST_PRECISION)
+        {
+            auto start = out.size();
+            out.resize(start + 2 + graph.size() + 1 + MAX_FLOAT_CHARS + 1 + MAX_UI64_CHARS);
+            char* it = out.data() + start;
+            char* end = out.data() + out.size();
+
+            *it++ = '1';
+            *it++ = ';';
+            std::memcpy(it, graph.data(), graph.size());
+            it += graph.size();
+            *it++ = ';';
+            it = FormatFloat(it, end, value, precision);
+            *it++ = ';';
+            it = std::to_chars(it, end, timestampUs).ptr;
+
+            out.resize(it - out.data());
+        }
+
+        static const size_t MAX_FLOAT_CHARS = 64;       //Fixed notation of FLT_MAX with MAX_PRECISION decimals fits
+        static const size_t MAX_UI64_CHARS = 20;
+
+        static char* FormatFloat(char* first, char* last, const float value, const i32 precision)
+        {
+            if (precision >= 0) {
+                auto result = std::to_chars(first, last, value, std::chars_format::fixed, std::min(precision, MAX_PRECISION));
+                if (result.ec == std::errc())
+                    return result.ptr;
+            }
+            return std::to_chars(first, last, value).ptr;
+        }
+
+        static TransmissionMsg CreateConfigurationVariableMessage(const std::map<std::string, RecvMessageConfig, std::less<>>& variables)
         {
             TransmissionMsg x;
 
@@ -61,7 +297,7 @@ namespace QD {
 
             x.message = oss.str();
 
-            std::cout << "[ConfigurationMessage] Configuration message: " << x.message << std::endl;
+            std::cout << "[ConfigurationMessage] Configuration message: " << x.message.c_str() << std::endl;
             return x;
         }
 
@@ -70,12 +306,14 @@ namespace QD {
             TransmissionMsg x;
 
             const char* messageType = "3";
-            x.message.reserve(4 * 1 + strlen(name));
-            x.message.append(messageType);
-            x.message.append(";");
-            x.message.append("1"); //enabled
-            x.message.append(";");
-            x.message.append(name);
+            std::string message;
+            message.reserve(4 * 1 + strlen(name));
+            message.append(messageType);
+            message.append(";");
+            message.append("1"); //enabled
+            message.append(";");
+            message.append(name);
+            x.message = message;
 
             return x;
         }
@@ -85,10 +323,12 @@ namespace QD {
             TransmissionMsg x;
 
             const char* messageType = "3";
-            x.message.reserve(3);
-            x.message.append(messageType);
-            x.message.append(";");
-            x.message.append("0");
+            std::string message;
+            message.reserve(3);
+            message.append(messageType);
+            message.append(";");
+            message.append("0");
+            x.message = message;
 
             return x;
         }
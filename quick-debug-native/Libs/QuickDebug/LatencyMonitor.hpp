@@ -1,137 +1,303 @@
 #ifndef STREAM_LATENCY_MONITOR
 #define STREAM_LATENCY_MONITOR
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdint>
-#include <vector>
+#include <cstring>
 #include <chrono>
 #include <map>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
 #include "QuickDebug.hpp"
+#include "SampleClock.hpp"
+#include "TraceWriter.hpp"
 #include "Common/Types.hpp"
 
 
 namespace QD
 {
-  struct TimestampMeasurement {
-    int64_t xrTimestamp;
-    std::vector<std::pair<const char*, std::chrono::time_point<std::chrono::steady_clock>>> timestamps;
-  };
-
   struct Measurement {
     int64_t xrTimestamp;
     std::chrono::time_point<std::chrono::steady_clock> startTime;
   };
 
+  // Identifies a pipeline stage of LatencyMonitor, returned by LatencyMonitor::RegisterStage()
+  struct StageId {
+    static const ui8 INVALID_ID = 0xFF;
+
+    ui8 Id = INVALID_ID;
+
+    bool IsValid() const {
+      return Id != INVALID_ID;
+    }
+  };
+
+  // Timestamp a frame passed one stage, see LatencyMonitor
+  // Same protocol as a seqlock, readers discard timestamps whose frame changed while they were read
+  struct LatencyStage {
+    std::atomic<i64> frame = -1;      //Frame the timestamp was taken for, timestamps of older frames are ignored
+    std::atomic<i64> prevFrame = -1;  //Latest older frame that passed the stage, -1 if unknown
+    std::atomic<std::chrono::steady_clock::rep> time = 0;
+
+    void Write(i64 newFrame, i64 newPrevFrame, std::chrono::steady_clock::rep newTime) {
+      frame.store(-1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      prevFrame.store(newPrevFrame, std::memory_order_relaxed);
+      time.store(newTime, std::memory_order_relaxed);
+      frame.store(newFrame, std::memory_order_release);
+    }
+
+    // Returns false if the stage holds no timestamp of the frame or it was overwritten while being read
+    bool Read(i64 expectedFrame, std::chrono::steady_clock::rep& outTime, i64& outPrevFrame) const {
+      if (frame.load(std::memory_order_acquire) != expectedFrame)
+        return false;
+
+      outTime = time.load(std::memory_order_relaxed);
+      outPrevFrame = prevFrame.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return frame.load(std::memory_order_relaxed) == expectedFrame;
+    }
+  };
+
+  template <size_t StageCount>
+  struct LatencyFrameSlot {
+    std::atomic<i64> frame = -1;      //-1 if the slot is empty
+    std::array<LatencyStage, StageCount> stages;
+  };
+
+  // Latencies between two consecutive stages
+  struct LatencyStagePair {
+    LatencyHistogram histogram;     //Latencies of the current summary interval
+    SeriesHandle latency, p50, p99, p999, max;
+    std::string name;               //"begin->end"
+  };
+
+  // Stage a frame passed on the thread that appended the record, see LatencyMonitor::TraceStage()
+  struct TraceRecord {
+    i64 frame = 0;
+    ui64 ticks = 0;
+    ui8 stage = 0;
+  };
+
+  /*
+    Timestamps of the pipeline stages a frame passed, identified by the frame's xrTimestamp.
+    Frames are kept in a fixed ring of slots indexed by xrTimestamp modulo the slot count, a slot is reused by the next
+    frame mapping to it. Each slot holds one timestamp per stage, indexed by the stage's id, so measurements never
+    allocate, lock or search.
+    Stages are registered once with RegisterStage() or Stage<"name">(), the overloads taking a name look the stage up.
+    The latencies between consecutive stages are collected in histograms and sent as percentiles once per summary interval.
+
+    Pipelines spanning several threads can be traced with TraceStage() instead: each thread appends its records to its own
+    buffer, a background aggregator joins them per frame and records the latencies between the stages and end to end.
+    While a TraceWriter trace is running, the latencies of each frame are also written as slices of the frame's timeline.
+   */
   class LatencyMonitor {
   public:
+    static constexpr ui32 MAX_FRAME_COUNT = 256;
+    static const ui32 MAX_STAGE_COUNT = 32;     //Further stages are not registered
+
+    /*
+      Number of frames kept (at most MAX_FRAME_COUNT), older frames are overwritten.
+      Can be changed at any time, frames mapped to another slot are not found anymore.
+     */
     static void SetMaxBufferSize(ui32 count) {
-      s_maxElementCount = count;
+      s_frameCount.store(std::clamp<ui32>(count, 1, MAX_FRAME_COUNT), std::memory_order_relaxed);
     }
 
-    static void TakeTimestampMeasurement(i64 xrTimestamp, const char* name) {
-      std::lock_guard<std::mutex> lock(s_apiMutex);
+    /*
+      Interval the percentiles (p50, p99, p99.9, max) of the latencies between stages are sent in, e.g. as "render->encode p99".
+      With an interval of 0 every latency is sent as a raw sample of "render->encode" instead.
+     */
+    static void SetSummaryInterval(std::chrono::milliseconds interval) {
+      s_summaryInterval.store(std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval).count(), std::memory_order_relaxed);
+    }
 
-      auto* timestampMeasurement = &s_registeredTimestampMeasurements[xrTimestamp];
-      timestampMeasurement->timestamps.push_back(std::make_pair(name, std::chrono::steady_clock::now()));
+    /*
+      Sends the percentiles of the current, unfinished summary interval right away and starts the next one, so the latencies
+      measured last are not lost when measuring stops. Called by StopPipelineTracing().
+     */
+    static void FlushSummaries() {
+      StageTime interval = s_summaryInterval.load(std::memory_order_relaxed);
+      if (interval <= 0)
+        return;
 
-      ClearOldTimestampData();
+      s_nextSummaryTime.store(std::chrono::steady_clock::now().time_since_epoch().count() + interval, std::memory_order_relaxed);
+      SendSummaries();
     }
 
     /*
-      Measures the time delta between this timestamp and the previous one with the given name.
+      Returns the id of the stage, registered on the first call (which takes a lock).
+      The name has to be persistent (e.g. a string literal), it is kept by address.
      */
-    static std::chrono::microseconds MeasureTimeDelta(i64 xrTimestamp, const char* name) {
-      std::lock_guard<std::mutex> lock(s_apiMutex);
-      auto it = s_registeredTimestampMeasurements.find(xrTimestamp);
-
-      std::chrono::steady_clock::time_point latestTimestamp;
-      if (it != s_registeredTimestampMeasurements.end() && it != s_registeredTimestampMeasurements.begin()) {
-        const auto& latestMeasurementTimestamps = it->second.timestamps;
-        auto measurementIt = std::find_if(latestMeasurementTimestamps.begin(), latestMeasurementTimestamps.end(), [name](const auto& pair) {
-            return std::strcmp(pair.first, name) == 0;
-        });
-        if (measurementIt == latestMeasurementTimestamps.end()) {
-            return std::chrono::microseconds(0); // No measurement found using xrTimestamp with the given name
-        }
-        latestTimestamp = measurementIt->second;
+    static StageId RegisterStage(const char* name) {
+      StageId stage = FindStage(name);
+      if (stage.IsValid())
+        return stage;
+
+      std::lock_guard<std::mutex> lock(s_stageMutex);
+      ui32 count = s_stageCount.load(std::memory_order_relaxed);
+      for (ui32 i = 0; i < count; i++) {
+        if (std::strcmp(s_stageNames[i].load(std::memory_order_relaxed), name) == 0)
+          return StageId{ static_cast<ui8>(i) };
       }
 
-      while (it != s_registeredTimestampMeasurements.end() && it != s_registeredTimestampMeasurements.begin()) {
-        --it;
-        const auto& prevMeasurementTimestamps = it->second.timestamps;
-        auto measurementPrevIt = std::find_if(prevMeasurementTimestamps.begin(), prevMeasurementTimestamps.end(), [name](const auto& pair) {
-          return std::strcmp(pair.first, name) == 0;
-        });
-        if (measurementPrevIt == prevMeasurementTimestamps.end()) {
-          continue; // The preceding measurment was found, but the entry with the given name was not found
-                    // Check further preceding elements, since it can happen that an entry in the measurement is skipped in between multiple measurements
-        }
-        auto prevTimestamp = measurementPrevIt->second;
+      if (count == MAX_STAGE_COUNT)
+        return StageId{};
 
-        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(latestTimestamp - prevTimestamp);
-        return latency;
-      } 
-      
-        return std::chrono::microseconds(0); // No preceding measurement was taken (this is the first measurement)
+      s_stageNames[count].store(name, std::memory_order_relaxed);
+      s_stageCount.store(count + 1, std::memory_order_release);
+      return StageId{ static_cast<ui8>(count) };
     }
 
-    static std::chrono::microseconds MeasureElapsedTime(i64 xrTimestamp, const char* begin, const char* end) {
-      std::lock_guard<std::mutex> lock(s_apiMutex);
+    // Returns the id of a stage named by a string literal, registered on the first call
+    // Usage: LatencyMonitor::TakeTimestampMeasurement(xrTimestamp, LatencyMonitor::Stage<"render">());
+    template <SeriesLiteral Name>
+    static StageId Stage() {
+      static const StageId stage = RegisterStage(Name.Name);
+      return stage;
+    }
 
-      auto* timestampMeasurement = &s_registeredTimestampMeasurements[xrTimestamp];
+    static void TakeTimestampMeasurement(i64 xrTimestamp, StageId stageId) {
+      auto time = std::chrono::steady_clock::now().time_since_epoch().count();
+      if (!stageId.IsValid())
+        return;
 
-      auto beginIt = std::find_if(timestampMeasurement->timestamps.begin(), timestampMeasurement->timestamps.end(), [begin](const auto& pair) {
-        return std::strcmp(pair.first, begin) == 0;
-      });
+      auto* slot = AcquireSlot(xrTimestamp);
+      if (slot == nullptr)
+        return; // A newer frame already uses the slot, the frame is too old to be kept
 
-      if (beginIt == timestampMeasurement->timestamps.end()) {
-        return std::chrono::microseconds(0);
+      auto& stage = slot->stages[stageId.Id];
+      if (stage.frame.load(std::memory_order_relaxed) == xrTimestamp)
+        return; // The first timestamp of a stage is kept
+
+      // The previous frame is only known while the stage is taken in frame order
+      i64 prevFrame = s_latestFrames[stageId.Id].load(std::memory_order_relaxed);
+      while (prevFrame < xrTimestamp && !s_latestFrames[stageId.Id].compare_exchange_weak(prevFrame, xrTimestamp, std::memory_order_relaxed)) {
       }
+      if (prevFrame >= xrTimestamp)
+        prevFrame = EMPTY_FRAME;
 
-      auto endIt = std::find_if(timestampMeasurement->timestamps.begin(), timestampMeasurement->timestamps.end(), [end](const auto& pair) {
-        return std::strcmp(pair.first, end) == 0;
-      });
+      stage.Write(xrTimestamp, prevFrame, time);
+    }
 
-      if (endIt == timestampMeasurement->timestamps.end()) {
+    static void TakeTimestampMeasurement(i64 xrTimestamp, const char* name) {
+      TakeTimestampMeasurement(xrTimestamp, RegisterStage(name));
+    }
+
+    /*
+      Measures the time delta between this timestamp and the previous one of the given stage.
+     */
+    static std::chrono::microseconds MeasureTimeDelta(i64 xrTimestamp, StageId stageId) {
+      StageTime latest, prev;
+      i64 prevFrame;
+      if (!ReadStage(xrTimestamp, stageId, latest, prevFrame))
+        return std::chrono::microseconds(0); // No measurement found using xrTimestamp with the given stage
+
+      i64 unused;
+      if (prevFrame == EMPTY_FRAME || !ReadStage(prevFrame, stageId, prev, unused))
+        return std::chrono::microseconds(0); // No preceding measurement is kept (e.g. this is the first measurement)
+      return ToMicroseconds(latest - prev);
+    }
+
+    static std::chrono::microseconds MeasureTimeDelta(i64 xrTimestamp, const char* name) {
+      return MeasureTimeDelta(xrTimestamp, FindStage(name));
+    }
+
+    static std::chrono::microseconds MeasureElapsedTime(i64 xrTimestamp, StageId begin, StageId end) {
+      StageTime beginTime, endTime;
+      i64 unused;
+      if (!ReadStage(xrTimestamp, begin, beginTime, unused) || !ReadStage(xrTimestamp, end, endTime, unused))
         return std::chrono::microseconds(0);
-      }
 
-      auto latency = std::chrono::duration_cast<std::chrono::microseconds>(endIt->second - beginIt->second);
-      return latency;
+      return ToMicroseconds(endTime - beginTime);
+    }
+
+    static std::chrono::microseconds MeasureElapsedTime(i64 xrTimestamp, const char* begin, const char* end) {
+      return MeasureElapsedTime(xrTimestamp, FindStage(begin), FindStage(end));
     }
 
 
     /*
-     Sends the timestamp measurements to the dashboard
+     Adds the latencies between the consecutive stages of the frame (ordered by time) and between its first and last stage
+     to the histograms of the stage pairs, the percentiles of all stage pairs are sent to the dashboard once the summary interval elapsed
      "deleteSentElements": Toggle for the automatic data cleanup on data transmission. 
                            Useful in combination with the MeasureTimestampDelta method since it requires comparison with old data, 
                            that might not exist anymore if it has already been sent
     */
     static void SendTimestampMeasurement(i64 xrTimestamp, bool deleteSentElements = false) {
-      std::lock_guard<std::mutex> lock(s_apiMutex);
-
-      auto* timestampMeasurement = &s_registeredTimestampMeasurements[xrTimestamp];
-      for (size_t i = 1; i < timestampMeasurement->timestamps.size(); i++)
-      {
-        auto& [name, timestamp] = timestampMeasurement->timestamps[i];
-        auto& [prevName, prevTimestamp] = timestampMeasurement->timestamps[i-1];
-        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(timestamp - prevTimestamp);
-
-        std::string sendName;
-        sendName += prevName;
-        sendName += "->";
-        sendName += name;
-        QD::QuickDebug::Plot(sendName, static_cast<float>(latency.count()));
+      std::array<StageTimestamp, MAX_STAGE_COUNT> stages;
+      size_t count = 0;
+      ui32 stageCount = s_stageCount.load(std::memory_order_acquire);
+      for (ui32 i = 0; i < stageCount; i++) {
+        StageTime time;
+        i64 unused;
+        if (ReadStage(xrTimestamp, StageId{ static_cast<ui8>(i) }, time, unused))
+          stages[count++] = StageTimestamp{ ToMicroseconds(time).count(), static_cast<ui8>(i) };
       }
 
+      RecordLatencies(xrTimestamp, std::span(stages.data(), count));
+      SendSummariesIfDue();
+
       if (deleteSentElements)
-        s_registeredTimestampMeasurements.erase(xrTimestamp);
+        EraseTimestamp(xrTimestamp);
     }
 
     static void EraseTimestamp(int64_t xrTimestamp) {
-        s_registeredTimestampMeasurements.erase(xrTimestamp);
+        i64 frame = xrTimestamp;
+        GetSlot(xrTimestamp).frame.compare_exchange_strong(frame, EMPTY_FRAME, std::memory_order_acq_rel);
     }
 
 
+    /*
+      Starts the aggregator thread of TraceStage(), frames without new records for frameTimeout are considered complete.
+      Records are timestamped with rdtsc if useTsc is set and the CPU has an invariant TSC.
+      Must not be called concurrently with StopPipelineTracing().
+     */
+    static void StartPipelineTracing(std::chrono::milliseconds frameTimeout = std::chrono::milliseconds(100), bool useTsc = true) {
+      if (s_isTracing.load(std::memory_order_acquire))
+        return;
+
+      s_traceStartUs = TraceWriter::NowUs();
+      s_traceClock.Start(useTsc);
+      s_frameTimeoutUs = static_cast<ui64>(frameTimeout.count()) * 1000;
+      s_isAggregating.store(true, std::memory_order_relaxed);
+      s_isTracing.store(true, std::memory_order_release);
+      std::thread(AggregateTraces).detach();
+    }
+
+    // Stops the aggregator, the records appended until then are still aggregated and included in a final summary
+    static void StopPipelineTracing() {
+      if (!s_isTracing.exchange(false, std::memory_order_acq_rel))
+        return;
+
+      while (s_isAggregating.load(std::memory_order_acquire))
+        std::this_thread::sleep_for(TRACE_POLL_INTERVAL);
+      FlushSummaries();
+    }
+
+    /*
+      Appends the time the frame passed the stage to the buffer of the calling thread, does nothing unless tracing was started.
+      Threads never share a lock or a cache line, records are dropped if the aggregator falls behind by TRACE_BUFFER_CAPACITY.
+     */
+    static void TraceStage(i64 frame, StageId stage) {
+      if (!s_isTracing.load(std::memory_order_acquire) || !stage.IsValid())
+        return;
+
+      thread_local PerThreadBuffers<TraceRecord>::Handle handle(s_traceBuffers, TRACE_BUFFER_CAPACITY);
+      if (!handle->Items.TryPush(TraceRecord{ frame, s_traceClock.Now(), stage.Id }))
+        handle->CountDropped();
+    }
+
+    // Usage: LatencyMonitor::TraceStage<"render">(xrTimestamp);
+    template <SeriesLiteral Name>
+    static void TraceStage(i64 frame) {
+      TraceStage(frame, Stage<Name>());
+    }
+
     static void StartMeasurement(const char* name) {
       s_registeredMeasurements[name] = Measurement{-1, std::chrono::steady_clock::now()};
     }
@@ -147,22 +313,239 @@ namespace QD
     }
 
   private:
-      static void ClearOldTimestampData() {
-          if (s_registeredTimestampMeasurements.size() <= s_maxElementCount) {
+      using StageTime = std::chrono::steady_clock::rep;
+      using FrameSlot = LatencyFrameSlot<MAX_STAGE_COUNT>;
+
+      static const i64 EMPTY_FRAME = -1;
+
+      // Looks the stage up without locking, names are compared by address first
+      static StageId FindStage(const char* name) {
+        ui32 count = s_stageCount.load(std::memory_order_acquire);
+        for (ui32 i = 0; i < count; i++) {
+          if (s_stageNames[i].load(std::memory_order_relaxed) == name)
+            return StageId{ static_cast<ui8>(i) };
+        }
+        for (ui32 i = 0; i < count; i++) {
+          if (std::strcmp(s_stageNames[i].load(std::memory_order_relaxed), name) == 0)
+            return StageId{ static_cast<ui8>(i) };
+        }
+        return StageId{};
+      }
+
+      // Returns the stage pair, the histogram and series of a pair are created the first time it is sent
+      static LatencyStagePair* GetStagePair(ui8 prevStage, ui8 stage) {
+          auto& stagePair = s_stagePairs[prevStage * MAX_STAGE_COUNT + stage];
+          auto* existing = stagePair.load(std::memory_order_acquire);
+          if (existing != nullptr)
+              return existing;
+
+          std::lock_guard<std::mutex> lock(s_stageMutex);
+          existing = stagePair.load(std::memory_order_relaxed);
+          if (existing != nullptr)
+              return existing;
+
+          std::string name;
+          name += s_stageNames[prevStage].load(std::memory_order_relaxed);
+          name += "->";
+          name += s_stageNames[stage].load(std::memory_order_relaxed);
+
+          auto created = std::make_unique<LatencyStagePair>();
+          created->latency = QD::QuickDebug::RegisterSeries(name.c_str());
+          created->p50 = QD::QuickDebug::RegisterSeries((name + " p50").c_str());
+          created->p99 = QD::QuickDebug::RegisterSeries((name + " p99").c_str());
+          created->p999 = QD::QuickDebug::RegisterSeries((name + " p99.9").c_str());
+          created->max = QD::QuickDebug::RegisterSeries((name + " max").c_str());
+          created->name = std::move(name);
+
+          stagePair.store(created.get(), std::memory_order_release);
+          s_stagePairStorage.push_back(std::move(created));
+          return s_stagePairStorage.back().get();
+      }
+
+      // Time in microseconds a frame passed a stage, on the clock of TraceWriter::NowUs()
+      struct StageTimestamp {
+          i64 timeUs;
+          ui8 stage;
+
+          bool operator<(const StageTimestamp& other) const {
+              return timeUs < other.timeUs;
+          }
+      };
+
+      // Records the latencies between the consecutive stages of a frame and, with more than two stages, between the first and last
+      static void RecordLatencies(i64 frame, std::span<StageTimestamp> stages) {
+          std::sort(stages.begin(), stages.end());
+          for (size_t i = 1; i < stages.size(); i++)
+              RecordLatency(frame, stages[i - 1], stages[i]);
+
+          if (stages.size() > 2)
+              RecordLatency(frame, stages.front(), stages.back());
+      }
+
+      static void RecordLatency(i64 frame, const StageTimestamp& begin, const StageTimestamp& end) {
+          auto* stagePair = GetStagePair(begin.stage, end.stage);
+          auto latency = end.timeUs - begin.timeUs;
+          if (TraceWriter::IsWriting())
+              TraceWriter::WriteAsyncSlice(stagePair->name, "LatencyMonitor", frame, static_cast<ui64>(begin.timeUs), static_cast<ui64>(end.timeUs));
+
+          if (s_summaryInterval.load(std::memory_order_relaxed) > 0)
+              stagePair->histogram.Record(static_cast<ui32>(std::min<i64>(latency, UINT32_MAX)));
+          else
+              QD::QuickDebug::Plot(stagePair->latency, static_cast<float>(latency));
+      }
+
+      // Sends the percentiles of the elapsed interval, the thread that claims the interval sends them for all stage pairs
+      static void SendSummariesIfDue() {
+          if (s_summaryInterval.load(std::memory_order_relaxed) <= 0)
+              return;
+
+          auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+          StageTime nextSummaryTime = s_nextSummaryTime.load(std::memory_order_relaxed);
+          if (now < nextSummaryTime)
+              return;
+          if (!s_nextSummaryTime.compare_exchange_strong(nextSummaryTime, now + s_summaryInterval.load(std::memory_order_relaxed), std::memory_order_relaxed))
               return;
+
+          if (nextSummaryTime == 0)
+              return; // The first interval starts now
+
+          SendSummaries();
+      }
+
+      // Sends the percentiles of the latencies recorded since the last summary and empties the histograms
+      static void SendSummaries() {
+          for (auto& stagePair : s_stagePairs) {
+              auto* pair = stagePair.load(std::memory_order_acquire);
+              if (pair == nullptr)
+                  continue;
+
+              LatencyHistogram window;
+              pair->histogram.MoveTo(window);
+              if (window.GetCount() == 0)
+                  continue;
+
+              QD::QuickDebug::Plot(pair->p50, static_cast<float>(window.GetPercentile(50)));
+              QD::QuickDebug::Plot(pair->p99, static_cast<float>(window.GetPercentile(99)));
+              QD::QuickDebug::Plot(pair->p999, static_cast<float>(window.GetPercentile(99.9)));
+              QD::QuickDebug::Plot(pair->max, static_cast<float>(window.GetMax()));
           }
+      }
 
-          //DEBUG_PRINT("Clearing old data " PRINT_INT64 " / " PRINT_INT64 "\r\n", s_registeredTimestampMeasurements.size(), s_maxElementCount);
-          while (s_registeredTimestampMeasurements.size() > 50) {
-              s_registeredTimestampMeasurements.erase(s_registeredTimestampMeasurements.begin()->first);
+      // Stages of a traced frame, joined from the records of all threads
+      struct TracedFrame {
+          std::array<ui64, MAX_STAGE_COUNT> ticks{};
+          ui32 stages = 0;                //Bit per stage that was traced
+          ui64 lastRecordUs = 0;          //Trace clock time the latest record was aggregated
+      };
+
+      static const size_t TRACE_BUFFER_CAPACITY = 4096;
+      static const size_t MAX_TRACED_FRAMES = 1024;     //The oldest frames are completed early if more are incomplete
+      static constexpr std::chrono::milliseconds TRACE_POLL_INTERVAL{ 2 };
+
+      // Aggregator thread, the only reader of the trace buffers
+      static void AggregateTraces() {
+          std::map<i64, TracedFrame> frames;
+
+          bool isTracing = true;
+          while (isTracing) {
+              isTracing = s_isTracing.load(std::memory_order_acquire);  //Drains once more after tracing stopped
+
+              auto nowUs = s_traceClock.ToMicroseconds(s_traceClock.Now());
+              s_traceBuffers.Drain([&](TraceRecord& record) {
+                  auto& frame = frames[record.frame];
+                  frame.ticks[record.stage] = record.ticks;
+                  frame.stages |= 1u << record.stage;
+                  frame.lastRecordUs = nowUs;
+              });
+
+              for (auto it = frames.begin(); it != frames.end();) {
+                  bool isComplete = !isTracing || frames.size() > MAX_TRACED_FRAMES || nowUs - it->second.lastRecordUs >= s_frameTimeoutUs;
+                  if (!isComplete) {
+                      ++it;
+                      continue;
+                  }
+
+                  CompleteTracedFrame(it->first, it->second);
+                  it = frames.erase(it);
+              }
+
+              ui64 dropped = s_traceBuffers.TakeDroppedCount();
+              if (dropped > 0)
+                  QD::QuickDebug::Plot(QD::QuickDebug::Series<"LatencyMonitor/DroppedRecords">(), static_cast<float>(dropped));
+
+              s_traceClock.Calibrate();
+              SendSummariesIfDue();
+              if (isTracing)
+                  std::this_thread::sleep_for(TRACE_POLL_INTERVAL);
           }
+          s_isAggregating.store(false, std::memory_order_release);
+      }
+
+      static void CompleteTracedFrame(i64 frameId, const TracedFrame& frame) {
+          std::array<StageTimestamp, MAX_STAGE_COUNT> stages;
+          size_t count = 0;
+          for (ui32 i = 0; i < MAX_STAGE_COUNT; i++) {
+              if (frame.stages & (1u << i))
+                  stages[count++] = StageTimestamp{ static_cast<i64>(s_traceStartUs + s_traceClock.ToMicroseconds(frame.ticks[i])), static_cast<ui8>(i) };
+          }
+          RecordLatencies(frameId, std::span(stages.data(), count));
+      }
+
+      static FrameSlot& GetSlot(i64 xrTimestamp) {
+        ui32 count = s_frameCount.load(std::memory_order_relaxed);
+        return s_slots[static_cast<ui64>(xrTimestamp) % count];
+      }
+
+      // Returns the slot of the frame, a slot holding an older frame is taken over (its timestamps are ignored from then on)
+      static FrameSlot* AcquireSlot(i64 xrTimestamp) {
+        auto& slot = GetSlot(xrTimestamp);
+        i64 frame = slot.frame.load(std::memory_order_acquire);
+        while (frame != xrTimestamp) {
+          if (frame > xrTimestamp)
+            return nullptr;
+          if (slot.frame.compare_exchange_weak(frame, xrTimestamp, std::memory_order_acq_rel))
+            break;
+        }
+        return &slot;
+      }
+
+      static bool ReadStage(i64 xrTimestamp, StageId stageId, StageTime& time, i64& prevFrame) {
+        if (!stageId.IsValid() || xrTimestamp < 0)
+          return false;
+
+        auto& slot = GetSlot(xrTimestamp);
+        if (slot.frame.load(std::memory_order_acquire) != xrTimestamp)
+          return false;
+
+        return slot.stages[stageId.Id].Read(xrTimestamp, time, prevFrame);
+      }
+
+      static std::chrono::microseconds ToMicroseconds(StageTime delta) {
+          return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::duration(delta));
       }
 
   private:
-    static inline std::mutex s_apiMutex;
-    static inline std::uint32_t s_maxElementCount = 100;
+    static inline std::atomic<ui32> s_frameCount = 100;
+    static inline std::array<FrameSlot, MAX_FRAME_COUNT> s_slots;
+
+    static inline std::mutex s_stageMutex;    //Serializes registering stages, lookups never take it
+    static inline std::atomic<ui32> s_stageCount = 0;
+    static inline std::array<std::atomic<const char*>, MAX_STAGE_COUNT> s_stageNames;
+    static inline std::array<std::atomic<i64>, MAX_STAGE_COUNT> s_latestFrames;     //Latest frame that passed each stage
+    static inline std::array<std::atomic<LatencyStagePair*>, MAX_STAGE_COUNT * MAX_STAGE_COUNT> s_stagePairs;   //Created on the first use
+    static inline std::vector<std::unique_ptr<LatencyStagePair>> s_stagePairStorage;
+
+    static inline std::atomic<StageTime> s_summaryInterval = std::chrono::steady_clock::duration(std::chrono::seconds(1)).count();
+    static inline std::atomic<StageTime> s_nextSummaryTime = 0;
+
+    static inline SampleClock s_traceClock;
+    static inline ui64 s_traceStartUs = 0;    //TraceWriter::NowUs() when the trace clock was started
+    static inline std::atomic<bool> s_isTracing = false;
+    static inline ui64 s_frameTimeoutUs = 0;
+    static inline std::atomic<bool> s_isAggregating = false;   //Cleared when the detached aggregator thread finished
+    static inline PerThreadBuffers<TraceRecord> s_traceBuffers;   //Drained by the aggregator thread only
+
     static inline std::map<const char*, Measurement> s_registeredMeasurements;
-    static inline std::map<int64_t, TimestampMeasurement> s_registeredTimestampMeasurements;
   };
 }
 
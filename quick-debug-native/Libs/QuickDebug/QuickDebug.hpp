@@ -5,6 +5,16 @@
 #include <thread>
 #include <chrono>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <span>
+#include <unordered_map>
+#include <charconv>
+#include <limits>
+#include <algorithm>
+#include <ranges>
 
 #include "Common.hpp"
 #include "Statistics.hpp"
@@ -13,6 +23,11 @@
 #include "Content/index.html.h"
 #include "httplib.h"
 #include "Entities.hpp"
+#include "BinaryProtocol.hpp"
+#include "SampleClock.hpp"
+#include "Decimator.hpp"
+#include "SeriesFilter.hpp"
+#include "SeriesRegistry.hpp"
 //There are also includes at the bottom of the file, since they depend on QuickDebug struct
 //TODO: Reorganise class
 
@@ -27,7 +42,7 @@ struct QuickDebug {
 		Startup();
 
 		// Send message to clients
-		m_server.BroadcastMessage(TransmissionMsg::CreatePlotMessage(graph.c_str(), value).message);
+		m_server.BroadcastMessage(TransmissionMsg::CreatePlotMessage(graph, value, GetTimestampUs()).message);
 	}
 
 	/// @brief Enqueues the transmission of a value to all connected clients. The message will then be sent by a worker thread when it is available.
@@ -43,7 +58,91 @@ struct QuickDebug {
 	static inline void Plot(const char* graph, float value) {
 		Startup();
 
-		m_messageQueue.Push(TransmissionMsg::CreatePlotMessage(graph, value));
+		EnqueueSample(TransmissionMsg::CreatePlotSample(graph, value, m_clock.Now()));
+	}
+
+	/// @brief Enqueues the transmission of a value of a registered series. Avoids copying the name of the series on every call.
+	/// @param series Handle returned by RegisterSeries()
+	/// @param value The value that should be plotted
+	static inline void Plot(SeriesHandle series, float value) {
+		Startup();
+
+		if (IsSubscribed(series))
+			EnqueueSample(TransmissionMsg::CreatePlotSample(series, value, m_clock.Now()));
+	}
+
+	/// @brief Enqueues the transmission of a value, the series name is hashed at compile time and registered on the first call
+	/// Usage: QuickDebug::Plot<"sin">(value);
+	/// @param value The value that should be plotted
+	template <SeriesLiteral Name>
+	static inline void Plot(float value) {
+		Plot(Series<Name>(), value);
+	}
+
+	/// @brief Enqueues a block of consecutive values of a series as a single message
+	/// @param series Handle returned by RegisterSeries()
+	/// @param values The values in the order they were sampled, the last value is timestamped with the time of the call
+	/// @param sampleIntervalUs Time between two values (> 0), the earlier values are timestamped backwards from the last one
+	static inline void Plot(SeriesHandle series, std::span<const float> values, float sampleIntervalUs) {
+		Startup();
+
+		if (IsSubscribed(series) && !values.empty())
+			EnqueueSample(TransmissionMsg::CreatePlotBlock(series, values, sampleIntervalUs, m_clock.Now()));
+	}
+
+	/// @brief Enqueues a block of consecutive values of a series named by a string literal
+	/// Usage: QuickDebug::Plot<"spectrum">(values, 20.0f);
+	template <SeriesLiteral Name>
+	static inline void Plot(std::span<const float> values, float sampleIntervalUs) {
+		Plot(Series<Name>(), values, sampleIntervalUs);
+	}
+
+	/// @brief Sets the number of decimals the values of a series are sent with by the text protocol.
+	/// By default the shortest text that reads back as the same float is sent. The binary protocol always sends the full float.
+	/// @param series Handle returned by RegisterSeries()
+	/// @param decimals Fixed number of decimals (at most TransmissionMsg::MAX_PRECISION), or TransmissionMsg::SHORTEST_PRECISION
+	static inline void SetPrecision(SeriesHandle series, i32 decimals) {
+		Startup();
+
+		if (series.IsValid())
+			EnqueueControlMessage(TransmissionMsg::CreateSeriesPrecisionMessage(series, decimals));
+	}
+
+	/// @brief Enqueues one value per series, all taken at the same time, as a single message
+	/// @param series Handles returned by RegisterSeries()
+	/// @param values values[i] is plotted in series[i]
+	static inline void PlotFrame(std::span<const SeriesHandle> series, std::span<const float> values) {
+		Startup();
+
+		if (std::ranges::any_of(series, IsSubscribed))
+			EnqueueSample(TransmissionMsg::CreatePlotFrame(series, values, m_clock.Now()));
+	}
+
+	/// @brief True if a connected client receives the series. Plot() discards samples of other series right away,
+	/// so expensive values can be skipped as well. Clients receive all series unless they send "QD/SubscribeOnly" or "QD/Unsubscribe"
+	static inline bool IsSubscribed(SeriesHandle series) {
+		if (!series.IsValid())
+			return false;
+		if (m_isEverySeriesSubscribed.load(std::memory_order_relaxed))
+			return true;
+
+		auto word = m_subscribedSeries[series.Id / SeriesFilter::WORD_BITS].load(std::memory_order_relaxed);
+		return (word >> (series.Id % SeriesFilter::WORD_BITS)) & 1;
+	}
+
+	/// @brief Registers a series and returns its handle. Takes a lock, so register once and reuse the handle for Plot().
+	/// Registering the same name multiple times returns the same handle.
+	/// @param name The name of the line in the chart
+	static inline SeriesHandle RegisterSeries(const char* name) {
+		return m_seriesRegistry.Register(name);
+	}
+
+	/// @brief Returns the handle of a series named by a string literal, registered on the first call
+	/// Usage: auto handle = QuickDebug::Series<"sin">();
+	template <SeriesLiteral Name>
+	static inline SeriesHandle Series() {
+		static const SeriesHandle handle = m_seriesRegistry.Register(std::string_view(Name.Name), Name.Hash);
+		return handle;
 	}
 
 
@@ -52,14 +151,14 @@ struct QuickDebug {
 	static inline void StartRecording(const char* name) {
 		Startup();
 
-		m_messageQueue.Push(TransmissionMsg::CreateStartRecordingMessage(name));
+		EnqueueControlMessage(TransmissionMsg::CreateStartRecordingMessage(name));
 	}
 
 	/// @brief Instructs the website to stop recording
 	static inline void StopRecording() {
 		Startup();
 
-		m_messageQueue.Push(TransmissionMsg::CreateStopRecordingMessage());
+		EnqueueControlMessage(TransmissionMsg::CreateStopRecordingMessage());
 	}
 
 	/// @brief Registers a key to be updated when a message with the key is received
@@ -124,15 +223,53 @@ struct QuickDebug {
 			return;
 
 		m_cfg = cfg;
+		m_clock.Start(m_cfg.UseTscClock);
 
 		m_server.SetMessageHandler(OnMessageReceived);
 		m_server.SetClientConnectedHandler(OnClientConnected);
+		m_server.SetClientDisconnectedHandler(OnClientDisconnected);
+		m_server.SetTcpOptions(m_cfg.TcpNoDelay, m_cfg.TcpCork);
+		m_server.SetOutboundLimit(m_cfg.MaxClientOutboundBytes, m_cfg.SlowClientPolicy);
+		m_server.SetIoThreadCount(m_cfg.IoThreadCount);
+		// Messages are compressed one at a time, which only pays off for batches
+		if (m_cfg.UseCompression && !m_cfg.UseBatching) {
+			std::cerr << "[QD] UseCompression requires UseBatching, compression is disabled" << std::endl;
+			m_cfg.UseCompression = false;
+		}
+		m_server.SetCompression(m_cfg.UseCompression, m_cfg.CompressionLevel, m_cfg.CompressionWindowBits);
+		m_messageQueue.SetCapacity(m_cfg.PlotQueueCapacity, m_cfg.PlotQueuePolicy);
+		m_publishBuffer.resize(PUBLISH_BULK_SIZE);
+
+		m_requestedPointsPerSecond.store(static_cast<i32>(m_cfg.DecimationPointsPerSecond), std::memory_order_relaxed);
+		m_requestedDecimationMode.store(static_cast<i32>(m_cfg.Decimation), std::memory_order_relaxed);
+		m_recvMessageConfigs["QD/PointsPerSecond"] = RecvMessageConfig(0, nullptr);	//Announced to clients, handled by OnDecimationMessage()
+		m_recvMessageConfigs["QD/DecimationMode"] = RecvMessageConfig(0, nullptr);
+		ApplyDecimationRequest();
+
 		m_server.Start(m_cfg.WebsocketPort);
 		m_publishPlotMessageThread = std::thread([&]() {
 			while (m_server.IsRunning())
 			{
-				auto data = m_messageQueue.Pop();
-				m_server.BroadcastMessage(data.message);
+				// Spins briefly once the queues are empty, then parks until a producer signals, the next deadline or the flush period
+				if (m_cfg.UsePerThreadQueues) {
+					if (!PublishPerThreadQueues() && !SpinWhileIdle(HasPerThreadMessages)) {
+						auto key = m_publisherWakeup.PrepareWait();
+						if (HasPerThreadMessages())
+							m_publisherWakeup.CancelWait();
+						else
+							m_publisherWakeup.Wait(key, std::chrono::microseconds(GetPublishTimeoutUs()));
+					}
+				}
+				else if (!PublishSharedQueue(std::chrono::microseconds(0)) && !SpinWhileIdle([]() { return !m_messageQueue.EmptyHint(); })) {
+					PublishSharedQueue(std::chrono::microseconds(GetPublishTimeoutUs()));
+				}
+
+				ApplyDecimationRequest();
+				ResolvePendingSubscriptions();
+				FlushDecimationIfDue();
+				FlushBatchIfDue();
+				PublishDroppedSamples();
+				m_clock.Calibrate();
 			}
 		});
 		m_publishPlotMessageThread.detach();
@@ -149,6 +286,7 @@ struct QuickDebug {
 	static inline void Shutdown() {
 		if (IsRunning()) {
 			m_server.Stop();
+			m_messageQueue.SetCapacity(0, m_cfg.PlotQueuePolicy);	//Releases producers blocked on a full queue
 
 			m_publishPlotMessageThread.join();
 			m_webserver.stop();
@@ -156,46 +294,619 @@ struct QuickDebug {
 		}
 	}
 
+	/// @brief Frames dropped for each connected client by the slow client policy
+	static inline std::vector<Ext::WebSocketServer::ClientStats> GetClientStats() {
+		return m_server.GetClientStats();
+	}
+
 private:
+	/// @brief Transparent hash, allows looking up series names by std::string_view without creating a std::string
+	struct SeriesNameHash {
+		using is_transparent = void;
+
+		size_t operator()(std::string_view name) const {
+			return std::hash<std::string_view>{}(name);
+		}
+	};
+
+	static inline void EnqueueSample(TransmissionMsg&& msg) {
+		if (!m_cfg.UsePerThreadQueues) {
+			m_messageQueue.PushBounded(std::move(msg), IsSample);	//Control messages share the queue and must not be evicted
+			return;
+		}
+
+		thread_local PerThreadBuffers<TransmissionMsg>::Handle handle(m_threadQueues, m_cfg.PerThreadQueueCapacity);
+		while (!handle->Items.TryPush(std::move(msg))) {
+			if (m_cfg.PlotQueuePolicy != QueueFullPolicy::Block || !IsRunning()) {
+				handle->CountDropped();
+				return;
+			}
+			std::this_thread::yield();
+		}
+		m_publisherWakeup.Notify();
+	}
+
+	static inline bool IsSample(const TransmissionMsg& msg) {
+		return msg.type == TransmissionMsgType::Sample || msg.type == TransmissionMsgType::SampleBlock || msg.type == TransmissionMsgType::SampleFrame;
+	}
+
+	/// @brief Queues a message that must not be dropped, like recordings and configuration
+	static inline void EnqueueControlMessage(TransmissionMsg&& msg) {
+		m_messageQueue.Push(std::move(msg));
+		if (m_cfg.UsePerThreadQueues)
+			m_publisherWakeup.Notify();	//The publisher parks on the wakeup instead of the queue in this mode
+	}
+
+	/// @brief Publishes the messages of the shared queue, waits at most timeout for the first one (publisher thread only)
+	/// @return false if there was nothing to publish
+	static inline bool PublishSharedQueue(std::chrono::microseconds timeout) {
+		size_t count = m_messageQueue.PopBulkFor(m_publishBuffer, timeout);
+		for (size_t i = 0; i < count; ++i)
+			PublishAndRelease(m_publishBuffer[i]);
+		return count > 0;
+	}
+
+	/// @brief Publishes a message of m_publishBuffer, which keeps it until it is overwritten, so a pooled payload is returned right away
+	static inline void PublishAndRelease(TransmissionMsg& data) {
+		Publish(data);
+		data.pooledPayload.reset();
+	}
+
+	/// @brief Yields up to PublisherSpinCount times until hasMessages() returns true, so bursts are picked up without parking
+	template <typename Predicate>
+	static inline bool SpinWhileIdle(Predicate hasMessages) {
+		for (ui32 i = 0; i < m_cfg.PublisherSpinCount; ++i) {
+			if (hasMessages())
+				return true;
+			std::this_thread::yield();
+		}
+		return false;
+	}
+
+	/// @brief Lock-free check for messages in the control queue or any per-thread ring buffer (publisher thread only)
+	static inline bool HasPerThreadMessages() {
+		return !m_messageQueue.EmptyHint() || m_threadQueues.HasItems();
+	}
+
+	/// @brief Drains the control message queue and all per-thread ring buffers once
+	/// @return false if there was nothing to publish
+	static inline bool PublishPerThreadQueues() {
+		bool published = false;
+
+		while (size_t count = m_messageQueue.PopBulkFor(m_publishBuffer, std::chrono::microseconds(0))) {
+			for (size_t i = 0; i < count; ++i)
+				PublishAndRelease(m_publishBuffer[i]);
+			published = true;
+		}
+
+		published |= m_threadQueues.Drain([](TransmissionMsg& data) { Publish(data); });
+		return published;
+	}
+
+	/// @brief Plots the number of samples dropped on full queues since the last report, at most every DROPPED_SAMPLES_INTERVAL_US.
+	/// Nothing is sent while no samples are dropped (publisher thread only)
+	static inline void PublishDroppedSamples() {
+		auto now = GetTimestampUs();
+		if (now < m_droppedSamplesReportUs + DROPPED_SAMPLES_INTERVAL_US)
+			return;
+		m_droppedSamplesReportUs = now;
+
+		ui64 queueDroppedSamples = m_messageQueue.DroppedCount();
+		ui64 dropped = queueDroppedSamples - m_reportedDroppedSamples + m_threadQueues.TakeDroppedCount();
+		m_reportedDroppedSamples = queueDroppedSamples;
+
+		// A final zero is sent after a phase of dropping, so the chart returns to the baseline
+		if (dropped > 0 || m_wasDroppingSamples)
+			Publish(TransmissionMsg::CreatePlotSample(Series<"QD/DroppedSamples">(), static_cast<f32>(dropped), m_clock.Now()));
+
+		m_wasDroppingSamples = dropped > 0;
+	}
+
+	/// @brief Encodes a message in the configured wire format and sends it to all clients (publisher thread only)
+	static inline void Publish(const TransmissionMsg& data) {
+		switch (data.type)
+		{
+		case TransmissionMsgType::Text:
+			FlushBatch();	//Keeps the order of samples and control messages
+			m_server.BroadcastMessage(data.message);
+			break;
+		case TransmissionMsgType::SeriesTable:
+			if (m_announcedSeriesCount > 0)
+				m_server.BroadcastBinaryMessage(BinaryProtocol::EncodeSeriesTable(m_seriesNames, 0, m_announcedSeriesCount));
+			break;
+		case TransmissionMsgType::Sample:
+		{
+			auto seriesId = ResolveSeries(data);
+			if (!IsSubscribed(SeriesHandle{ seriesId }))
+				break;
+
+			auto timestampUs = m_clock.ToMicroseconds(data.timestamp);
+			if (m_decimationPointsPerSecond > 0)
+				DecimateSample(seriesId, timestampUs, data.value);
+			else
+				PublishSample(seriesId, timestampUs, data.value);
+			break;
+		}
+		case TransmissionMsgType::SeriesPrecision:
+			if (data.seriesId >= m_seriesPrecisions.size())
+				m_seriesPrecisions.resize(data.seriesId + 1, TransmissionMsg::SHORTEST_PRECISION);
+			m_seriesPrecisions[data.seriesId] = data.precision;
+			break;
+		case TransmissionMsgType::Subscription:
+			ApplySubscription(data);
+			break;
+		case TransmissionMsgType::SampleBlock:
+		{
+			auto seriesId = ResolveSeries(data.seriesId);
+			if (!IsSubscribed(SeriesHandle{ seriesId }))
+				break;
+
+			auto payload = data.Payload();
+			auto count = payload.size() / sizeof(f32);
+			auto lastTimestampUs = static_cast<f64>(m_clock.ToMicroseconds(data.timestamp));
+			for (size_t i = 0; i < count; ++i) {
+				f32 value;
+				std::memcpy(&value, payload.data() + i * sizeof(f32), sizeof(f32));
+				auto timestampUs = static_cast<ui64>(std::max(0.0, lastTimestampUs - static_cast<f64>(count - 1 - i) * data.value));
+				AddSample(seriesId, timestampUs, value);
+			}
+			FlushUnbatchedSamples();
+			break;
+		}
+		case TransmissionMsgType::SampleFrame:
+		{
+			auto payload = data.Payload();
+			auto count = payload.size() / TransmissionMsg::FRAME_ENTRY_SIZE;
+			auto timestampUs = m_clock.ToMicroseconds(data.timestamp);
+			for (size_t i = 0; i < count; ++i) {
+				const char* entry = payload.data() + i * TransmissionMsg::FRAME_ENTRY_SIZE;
+				ui16 seriesId;
+				f32 value;
+				std::memcpy(&seriesId, entry, sizeof(ui16));
+				std::memcpy(&value, entry + sizeof(ui16), sizeof(f32));
+				if (IsSubscribed(SeriesHandle{ seriesId }))
+					AddSample(ResolveSeries(seriesId), timestampUs, value);
+			}
+			FlushUnbatchedSamples();
+			break;
+		}
+		}
+	}
+
+	/// @brief Adds a sample of a block or frame to the decimator or the pending batch. Without batching, the caller sends all
+	/// samples of the message as one frame by calling FlushUnbatchedSamples() afterwards
+	static inline void AddSample(ui16 seriesId, ui64 timestampUs, f32 value) {
+		if (m_decimationPointsPerSecond > 0)
+			DecimateSample(seriesId, timestampUs, value);
+		else
+			BatchSample(seriesId, timestampUs, value);
+	}
+
+	static inline void FlushUnbatchedSamples() {
+		if (!m_cfg.UseBatching)
+			FlushBatch();
+	}
+
+	/// @brief Encodes a single sample in the configured wire format and sends or batches it (publisher thread only)
+	static inline void PublishSample(ui16 seriesId, ui64 timestampUs, f32 value) {
+		if (!m_cfg.UseBinaryProtocol && !m_cfg.UseBatching) {
+			m_encodeBuffer.clear();
+			TransmissionMsg::AppendPlotMessage(m_encodeBuffer, m_seriesNames[seriesId], value, timestampUs, GetPrecision(seriesId));
+			for (size_t i = 0; i < m_subscriptionGroups.size(); ++i) {
+				if (m_subscriptionGroups[i].Contains(seriesId))
+					m_server.BroadcastMessage(m_encodeBuffer, Ext::WebSocketServer::OPCODE_TEXT, true, GetGroupId(i));
+			}
+			return;
+		}
+
+		BatchSample(seriesId, timestampUs, value);
+		FlushUnbatchedSamples();
+	}
+
+	/// @brief Appends a sample to the pending batch, which is sent when it is full or its deadline passed
+	static inline void BatchSample(ui16 seriesId, ui64 timestampUs, f32 value) {
+		if (!m_cfg.UseBinaryProtocol) {
+			// Batched text samples are separated by line breaks
+			if (m_batchSampleCount > 0)
+				m_batchText += '\n';
+			TransmissionMsg::AppendPlotMessage(m_batchText, m_seriesNames[seriesId], value, timestampUs, GetPrecision(seriesId));
+			m_batchTextLines.push_back(BatchLine{ seriesId, m_batchText.size() });
+			AddedToBatch(timestampUs);
+			return;
+		}
+
+		// Announce all series registered since the last announcement before their first sample
+		if (seriesId >= m_announcedSeriesCount) {
+			auto seriesCount = static_cast<ui16>(m_seriesNames.size());
+			m_server.BroadcastBinaryMessage(BinaryProtocol::EncodeSeriesTable(m_seriesNames, m_announcedSeriesCount, seriesCount));
+			m_announcedSeriesCount = seriesCount;
+		}
+
+		m_batchSamples.push_back(BinaryProtocol::Sample{ seriesId, timestampUs, value });
+		AddedToBatch(timestampUs);
+	}
+
+	/// @brief Adds a sample to the decimator of its series, reduced points are published when a bucket is closed
+	static inline void DecimateSample(ui16 seriesId, ui64 timestampUs, f32 value) {
+		if (seriesId >= m_decimators.size())
+			m_decimators.resize(seriesId + 1);
+
+		m_decimators[seriesId].Add(timestampUs, value, m_decimationMode, m_decimationBucketUs, [seriesId](ui64 pointUs, f32 pointValue) {
+			PublishSample(seriesId, pointUs, pointValue);
+		});
+
+		if (!m_hasOpenBuckets) {
+			m_hasOpenBuckets = true;
+			m_decimationFlushUs = GetTimestampUs() + m_decimationBucketUs;
+		}
+	}
+
+	/// @brief Emits the open buckets of all series, which did not receive a sample for a whole bucket after their bucket ended.
+	/// Checked once per bucket length (publisher thread only)
+	static inline void FlushDecimationIfDue() {
+		if (!m_hasOpenBuckets)
+			return;
+
+		auto now = GetTimestampUs();
+		if (now < m_decimationFlushUs)
+			return;
+
+		m_hasOpenBuckets = false;
+		for (size_t id = 0; id < m_decimators.size(); ++id) {
+			auto& decimator = m_decimators[id];
+			if (!decimator.HasOpenBucket())
+				continue;
+
+			if (decimator.GetBucketEndUs(m_decimationBucketUs) + m_decimationBucketUs <= now)
+				FlushDecimator(static_cast<ui16>(id));
+			else
+				m_hasOpenBuckets = true;
+		}
+		m_decimationFlushUs = now + m_decimationBucketUs;
+	}
+
+	static inline void FlushDecimator(ui16 seriesId) {
+		m_decimators[seriesId].Flush(m_decimationMode, [seriesId](ui64 pointUs, f32 pointValue) {
+			PublishSample(seriesId, pointUs, pointValue);
+		});
+	}
+
+	/// @brief Applies a resolution requested by a client through "QD/PointsPerSecond" or "QD/DecimationMode".
+	/// Frames are encoded once for all clients, so the last request applies to every client (publisher thread only)
+	static inline void ApplyDecimationRequest() {
+		auto pointsPerSecond = static_cast<ui32>(std::max<i32>(0, m_requestedPointsPerSecond.load(std::memory_order_relaxed)));
+		auto mode = static_cast<DecimationMode>(std::clamp<i32>(m_requestedDecimationMode.load(std::memory_order_relaxed), 0, static_cast<i32>(DecimationMode::Lttb)));
+		if (pointsPerSecond == m_decimationPointsPerSecond && mode == m_decimationMode)
+			return;
+
+		// Buffered points are emitted with the old settings
+		for (size_t id = 0; id < m_decimators.size(); ++id)
+			FlushDecimator(static_cast<ui16>(id));
+		m_hasOpenBuckets = false;
+
+		m_decimationPointsPerSecond = pointsPerSecond;
+		m_decimationMode = mode;
+		m_decimationBucketUs = SeriesDecimator::GetBucketLengthUs(pointsPerSecond, mode);
+	}
+
+	/// @brief Updates the batch deadline after a sample was added and sends the batch if it is full
+	static inline void AddedToBatch(ui64 sampleTimestampUs) {
+		m_batchSampleCount++;
+		if (!m_cfg.UseBatching) {
+			// Samples of a block are collected until FlushUnbatchedSamples(), only the message size limits them
+			if (m_batchSampleCount >= BinaryProtocol::MAX_SAMPLES_PER_MESSAGE)
+				FlushBatch();
+			return;
+		}
+
+		if (m_batchSampleCount == 1)
+			m_batchDeadlineUs = GetTimestampUs() + m_cfg.BatchWindowUs;
+		if (m_cfg.BatchMaxLatencyUs > 0)
+			m_batchDeadlineUs = std::min<ui64>(m_batchDeadlineUs, sampleTimestampUs + m_cfg.BatchMaxLatencyUs);
+
+		if (m_batchSampleCount >= std::min<size_t>(m_cfg.BatchMaxSamples, BinaryProtocol::MAX_SAMPLES_PER_MESSAGE))
+			FlushBatch();
+	}
+
+	/// @brief True while batched samples or open decimation buckets are waiting for their deadline
+	static inline bool HasPendingOutput() {
+		return m_batchSampleCount > 0 || m_hasOpenBuckets;
+	}
+
+	/// @brief Microseconds the idle publisher may park: until the pending batch or the open decimation buckets have to be sent,
+	/// at most PublisherFlushPeriodUs
+	static inline ui64 GetPublishTimeoutUs() {
+		if (!HasPendingOutput())
+			return m_cfg.PublisherFlushPeriodUs;
+
+		auto deadline = m_batchSampleCount > 0 ? m_batchDeadlineUs : std::numeric_limits<ui64>::max();
+		if (m_hasOpenBuckets)
+			deadline = std::min(deadline, m_decimationFlushUs);
+
+		auto now = GetTimestampUs();
+		return deadline > now ? std::min<ui64>(deadline - now, m_cfg.PublisherFlushPeriodUs) : 0;
+	}
+
+	static inline void FlushBatchIfDue() {
+		if (m_batchSampleCount > 0 && GetTimestampUs() >= m_batchDeadlineUs)
+			FlushBatch();
+	}
+
+	/// @brief Sends all batched samples as a single frame per subscription group, each group only receives its series
+	static inline void FlushBatch() {
+		if (m_batchSampleCount == 0)
+			return;
+
+		// Samples nobody subscribed are never batched, a single group receives the whole batch
+		if (m_subscriptionGroups.size() == 1) {
+			if (m_cfg.UseBinaryProtocol) {
+				BinaryProtocol::EncodeSamples(m_batchSamples, m_encodeBuffer);
+				m_server.BroadcastBinaryMessage(m_encodeBuffer, true, GetGroupId(0));
+			}
+			else {
+				m_server.BroadcastMessage(m_batchText, Ext::WebSocketServer::OPCODE_TEXT, true, GetGroupId(0));
+			}
+		}
+		else {
+			for (size_t i = 0; i < m_subscriptionGroups.size(); ++i)
+				FlushBatch(i);
+		}
+
+		m_batchSamples.clear();
+		m_batchText.clear();
+		m_batchTextLines.clear();
+		m_batchSampleCount = 0;
+	}
+
+	/// @brief Sends the samples of the pending batch that subscription group i subscribed
+	static inline void FlushBatch(size_t i) {
+		const auto& filter = m_subscriptionGroups[i];
+		if (m_cfg.UseBinaryProtocol) {
+			m_groupSamples.clear();
+			for (const auto& sample : m_batchSamples) {
+				if (filter.Contains(sample.SeriesId))
+					m_groupSamples.push_back(sample);
+			}
+
+			if (!m_groupSamples.empty()) {
+				BinaryProtocol::EncodeSamples(m_groupSamples, m_encodeBuffer);
+				m_server.BroadcastBinaryMessage(m_encodeBuffer, true, GetGroupId(i));
+			}
+			return;
+		}
+
+		m_encodeBuffer.clear();
+		size_t lineStart = 0;
+		for (const auto& line : m_batchTextLines) {
+			if (filter.Contains(line.SeriesId)) {
+				if (!m_encodeBuffer.empty())
+					m_encodeBuffer += '\n';
+				m_encodeBuffer.append(m_batchText, lineStart, line.End - lineStart);
+			}
+			lineStart = line.End + 1;
+		}
+
+		if (!m_encodeBuffer.empty())
+			m_server.BroadcastMessage(m_encodeBuffer, Ext::WebSocketServer::OPCODE_TEXT, true, GetGroupId(i));
+	}
+
+	/// @brief Updates the series filter of a client, see SubscriptionAction (publisher thread only)
+	static inline void ApplySubscription(const TransmissionMsg& data) {
+		auto socket = data.subscriber;
+		auto action = data.subscriptionAction;
+
+		// Pending samples are sent to the current groups
+		FlushBatch();
+
+		auto client = std::ranges::find(m_clientSubscriptions, socket, &ClientSubscription::Socket);
+		if (action == SubscriptionAction::Connected) {
+			// The socket of a closed connection may be reused
+			if (client == m_clientSubscriptions.end())
+				m_clientSubscriptions.push_back(ClientSubscription{ socket });
+			else {
+				client->Filter.Reset(true);
+				client->PendingNames.clear();
+			}
+		}
+		else if (client == m_clientSubscriptions.end()) {
+			return;
+		}
+		else if (action == SubscriptionAction::Disconnected) {
+			m_clientSubscriptions.erase(client);
+		}
+		else {
+			if (action == SubscriptionAction::SubscribeAll || action == SubscriptionAction::SubscribeOnly) {
+				client->Filter.Reset(action == SubscriptionAction::SubscribeAll);
+				client->PendingNames.clear();
+			}
+
+			for (auto part : std::views::split(data.message.view(), ';')) {
+				std::string_view name(part.begin(), part.end());
+				if (name.empty())
+					continue;
+
+				// Names are only looked up, so clients can not fill the id space. Series that are not registered yet
+				// are remembered per client and added once they are registered, see ResolvePendingSubscriptions()
+				auto seriesId = m_seriesRegistry.Find(name).Id;
+				bool isUnsubscribe = action == SubscriptionAction::Unsubscribe;
+				if (seriesId != SeriesHandle::INVALID_ID) {
+					if (isUnsubscribe)
+						client->Filter.Remove(seriesId);
+					else
+						client->Filter.Add(seriesId);
+				}
+				else if (isUnsubscribe) {
+					std::erase(client->PendingNames, name);
+				}
+				else if (client->PendingNames.size() < MAX_PENDING_SERIES_NAMES && std::ranges::find(client->PendingNames, name) == client->PendingNames.end()) {
+					client->PendingNames.emplace_back(name);
+				}
+			}
+		}
+
+		m_pendingNameCount = CountPendingNames();
+		UpdateSubscriptionGroups();
+	}
+
+	static inline size_t CountPendingNames() {
+		size_t count = 0;
+		for (auto& client : m_clientSubscriptions)
+			count += client.PendingNames.size();
+		return count;
+	}
+
+	/// @brief Adds series registered since the last call to the filters of the clients that subscribed them by name before.
+	/// Plot() discards samples of series that are not subscribed, so new series are picked up from the registry (publisher thread only)
+	static inline void ResolvePendingSubscriptions() {
+		if (m_pendingNameCount == 0 || m_seriesRegistry.Size() == m_seriesNames.size())
+			return;
+
+		m_seriesRegistry.CopyNewNames(m_seriesNames);
+		bool isChanged = false;
+		for (auto& client : m_clientSubscriptions) {
+			isChanged |= std::erase_if(client.PendingNames, [&client](const std::string& name) {
+				auto seriesId = m_seriesRegistry.Find(name).Id;
+				if (seriesId == SeriesHandle::INVALID_ID)
+					return false;
+				client.Filter.Add(seriesId);
+				return true;
+			}) > 0;
+		}
+
+		m_pendingNameCount = CountPendingNames();
+		if (isChanged) {
+			FlushBatch();
+			UpdateSubscriptionGroups();
+		}
+	}
+
+	/// @brief Puts clients with equal filters into the same broadcast group, so frames are still encoded once per group.
+	/// Publishes the union of all filters for IsSubscribed()
+	static inline void UpdateSubscriptionGroups() {
+		m_subscriptionGroups.clear();
+		for (auto& client : m_clientSubscriptions) {
+			auto group = std::ranges::find(m_subscriptionGroups, client.Filter);
+			auto groupId = GetGroupId(group - m_subscriptionGroups.begin());
+			if (group == m_subscriptionGroups.end())
+				m_subscriptionGroups.push_back(client.Filter);
+
+			if (client.Group != groupId) {
+				client.Group = groupId;
+				m_server.SetClientGroup(client.Socket, groupId);
+			}
+		}
+
+		bool isEverySeriesSubscribed = false;
+		for (const auto& filter : m_subscriptionGroups)
+			isEverySeriesSubscribed |= filter.IsAll();
+
+		for (size_t word = 0; word < SUBSCRIBED_SERIES_WORDS; ++word) {
+			ui64 bits = 0;
+			for (const auto& filter : m_subscriptionGroups)
+				bits |= filter.GetWord(word);
+			m_subscribedSeries[word].store(bits, std::memory_order_relaxed);
+		}
+		m_isEverySeriesSubscribed.store(isEverySeriesSubscribed, std::memory_order_relaxed);
+	}
+
+	/// @brief Broadcast group of m_subscriptionGroups[i], group 0 are clients the publisher did not handle yet
+	static inline ui32 GetGroupId(size_t i) {
+		return static_cast<ui32>(i + 1);
+	}
+
+	/// @brief Returns the series id of a sample and makes sure its name is available in m_seriesNames (publisher thread only)
+	static inline ui16 ResolveSeries(const TransmissionMsg& data) {
+		auto seriesId = data.seriesId;
+		if (seriesId == SeriesHandle::INVALID_ID) {
+			// Samples plotted by name, the publisher keeps its own cache so that the registry lock is only taken for new names
+			auto it = m_seriesIdsByName.find(data.message.view());
+			if (it != m_seriesIdsByName.end())
+				return it->second;
+
+			seriesId = m_seriesRegistry.Register(data.message.c_str()).Id;
+			if (seriesId == SeriesHandle::INVALID_ID)
+				return seriesId;
+			m_seriesIdsByName.emplace(data.message.view(), seriesId);
+		}
+
+		return ResolveSeries(seriesId);
+	}
+
+	/// @brief Makes sure the name of a registered series is available in m_seriesNames (publisher thread only)
+	static inline ui16 ResolveSeries(ui16 seriesId) {
+		if (seriesId >= m_seriesNames.size())
+			m_seriesRegistry.CopyNewNames(m_seriesNames);
+		return seriesId;
+	}
+
+	static inline i32 GetPrecision(ui16 seriesId) {
+		return seriesId < m_seriesPrecisions.size() ? m_seriesPrecisions[seriesId] : TransmissionMsg::SHORTEST_PRECISION;
+	}
+
+	/// @brief Microseconds since Startup() on the sample clock
+	static inline ui64 GetTimestampUs() {
+		return m_clock.ToMicroseconds(m_clock.Now());
+	}
+
 	static inline void OnClientConnected(SOCKET s)
 	{
-		m_messageQueue.Push(TransmissionMsg::CreateConfigurationVariableMessage(m_recvMessageConfigs));
+		EnqueueControlMessage(TransmissionMsg::CreateSubscriptionMessage(s, SubscriptionAction::Connected));
+		EnqueueControlMessage(TransmissionMsg::CreateConfigurationVariableMessage(m_recvMessageConfigs));
+		if (m_cfg.UseBinaryProtocol)
+			EnqueueControlMessage(TransmissionMsg::CreateSeriesTableRequest());
 		std::cout << "[QD] OnClientConnected: " << s << "\n";
 	}
 
-	static inline void OnMessageReceived(SOCKET s, const std::string& msg) {
-		auto key = msg.substr(0, msg.find(';'));
-		auto value = msg.substr(msg.find(';') + 1);
+	static inline void OnClientDisconnected(SOCKET s)
+	{
+		EnqueueControlMessage(TransmissionMsg::CreateSubscriptionMessage(s, SubscriptionAction::Disconnected));
+	}
+
+	/// @brief Updates the value registered for the key of a "key;value" message, invalid values are ignored
+	static inline void OnMessageReceived(SOCKET s, std::string_view msg) {
+		auto separator = msg.find(';');
+		auto key = msg.substr(0, separator);
+		if (separator == std::string_view::npos) {
+			OnSubscriptionMessage(s, key, {});
+			return;
+		}
+
+		auto value = msg.substr(separator + 1);
+		if (OnSubscriptionMessage(s, key, value) || OnDecimationMessage(key, value))
+			return;
 
 		auto it = m_recvMessageConfigs.find(key);
 		if (it == m_recvMessageConfigs.end())
 			return;
 
 		auto config = it->second;
+		const char* valueEnd = value.data() + value.size();
 		switch (config.targetValueType)
 		{
 		case 1:
 		{
 			auto* targetValue = (float*)config.targetValue;
-			*targetValue = std::stof(value);
+			std::from_chars(value.data(), valueEnd, *targetValue);
 			break;
 		}
 		case 2:
 		{
 			auto* targetValue = (i32*)config.targetValue;
-			*targetValue = std::stoi(value);
+			std::from_chars(value.data(), valueEnd, *targetValue);
 			break;
 		}
 		case 3:
 		{
 			auto* targetValue = (FixedString<32>*)(config.targetValue);
-			*targetValue = FixedString<32>(value.c_str());
+			*targetValue = FixedString<32>(std::string(value));
 			break;
 		}
 		case 4:
 		{
 			auto* targetValue = (bool*)config.targetValue;
-			*targetValue = (bool) std::stoi(value);
+			i32 parsedValue;
+			if (std::from_chars(value.data(), valueEnd, parsedValue).ec == std::errc())
+				*targetValue = (bool) parsedValue;
 			break;
 		}
 		default:
@@ -204,6 +915,42 @@ private:
 
 	}
 
+	/// @brief Stores "QD/PointsPerSecond" and "QD/DecimationMode" for the publisher, see ApplyDecimationRequest()
+	/// @return false if key is not a decimation key
+	static inline bool OnDecimationMessage(std::string_view key, std::string_view value) {
+		std::atomic<i32>* target;
+		if (key == "QD/PointsPerSecond")
+			target = &m_requestedPointsPerSecond;
+		else if (key == "QD/DecimationMode")
+			target = &m_requestedDecimationMode;
+		else
+			return false;
+
+		i32 parsedValue;
+		if (std::from_chars(value.data(), value.data() + value.size(), parsedValue).ec == std::errc())
+			target->store(parsedValue, std::memory_order_relaxed);
+		return true;
+	}
+
+	/// @brief Forwards "QD/Subscribe", "QD/Unsubscribe", "QD/SubscribeOnly" and "QD/SubscribeAll" to the publisher
+	/// @return false if key is not a subscription key
+	static inline bool OnSubscriptionMessage(SOCKET s, std::string_view key, std::string_view seriesNames) {
+		SubscriptionAction action;
+		if (key == "QD/Subscribe")
+			action = SubscriptionAction::Subscribe;
+		else if (key == "QD/Unsubscribe")
+			action = SubscriptionAction::Unsubscribe;
+		else if (key == "QD/SubscribeOnly")
+			action = SubscriptionAction::SubscribeOnly;
+		else if (key == "QD/SubscribeAll")
+			action = SubscriptionAction::SubscribeAll;
+		else
+			return false;
+
+		EnqueueControlMessage(TransmissionMsg::CreateSubscriptionMessage(s, action, seriesNames));
+		return true;
+	}
+
 	static inline bool IsRunning() {
 		return m_server.IsRunning();
 	}
@@ -217,14 +964,66 @@ private:
 	}
 
 	static inline ConcurrentQueue<TransmissionMsg> m_messageQueue;
+
+	static inline EventCount m_publisherWakeup;							//Signalled by producers while the publisher is parked (per-thread queues)
+	static inline PerThreadBuffers<TransmissionMsg> m_threadQueues;		//Ring buffers of the producer threads (per-thread queues)
+
+	static const ui64 DROPPED_SAMPLES_INTERVAL_US = 100000;
+	static inline ui64 m_droppedSamplesReportUs = 0;						//Publisher thread only
+	static inline ui64 m_reportedDroppedSamples = 0;						//Publisher thread only, dropped samples of the shared queue
+	static inline bool m_wasDroppingSamples = false;						//Publisher thread only
 	static inline std::thread m_publishPlotMessageThread;
 
 	static inline std::thread m_webServerThread;
 	static inline httplib::Server m_webserver;
 
 	static inline QuickDebugConfig m_cfg;
+	static inline SampleClock m_clock;
+	static inline SeriesRegistry m_seriesRegistry;
+
+	// Publisher thread only
+	static inline std::vector<std::string> m_seriesNames;					//Copy of the registered names, indexed by series id
+	static inline std::unordered_map<std::string, ui16, SeriesNameHash, std::equal_to<>> m_seriesIdsByName;	//Series plotted by name
+	static inline std::vector<i32> m_seriesPrecisions;						//Text protocol decimals, indexed by series id
+	static inline ui16 m_announcedSeriesCount = 0;							//Series ids below this were sent to the clients
+	static inline std::vector<BinaryProtocol::Sample> m_batchSamples;		//Pending batch, binary protocol
+	static inline std::string m_batchText;									//Pending batch, text protocol
+	struct BatchLine {
+		ui16 SeriesId;
+		size_t End;		//Offset behind the line in m_batchText
+	};
+	static inline std::vector<BatchLine> m_batchTextLines;					//Series of each line in m_batchText
+	static inline std::vector<BinaryProtocol::Sample> m_groupSamples;		//Samples of the batch a subscription group receives
+	static inline std::string m_encodeBuffer;								//Reused for every encoded message
+	static const size_t PUBLISH_BULK_SIZE = 256;
+	static inline std::vector<TransmissionMsg> m_publishBuffer;				//Messages taken from the queue at once
+	static inline size_t m_batchSampleCount = 0;
+	static inline ui64 m_batchDeadlineUs = 0;								//Time since startup when the pending batch is sent
+	static inline std::vector<SeriesDecimator> m_decimators;				//Indexed by series id
+	static inline ui32 m_decimationPointsPerSecond = 0;						//0 = decimation disabled
+	static inline DecimationMode m_decimationMode = DecimationMode::MinMax;
+	static inline ui64 m_decimationBucketUs = 0;
+	static inline bool m_hasOpenBuckets = false;
+	static inline ui64 m_decimationFlushUs = 0;								//Time since startup when idle buckets are checked next
+	static inline std::atomic<i32> m_requestedPointsPerSecond = 0;		//Written by the I/O threads, applied by the publisher
+	static inline std::atomic<i32> m_requestedDecimationMode = 0;
+	struct ClientSubscription {
+		SOCKET Socket = INVALID_SOCKET;
+		SeriesFilter Filter = {};
+		ui32 Group = 0;
+		std::vector<std::string> PendingNames = {};							//Subscribed series that are not registered yet
+	};
+	static const size_t MAX_PENDING_SERIES_NAMES = 256;						//Per client, further unknown names are ignored
+	static inline std::vector<ClientSubscription> m_clientSubscriptions;
+	static inline size_t m_pendingNameCount = 0;							//Of all clients
+	static inline std::vector<SeriesFilter> m_subscriptionGroups;			//Distinct filters of the clients, see GetGroupId()
+
+	// Union of all client filters, read by Plot() on any thread
+	static const size_t SUBSCRIBED_SERIES_WORDS = (SeriesHandle::INVALID_ID + SeriesFilter::WORD_BITS - 1) / SeriesFilter::WORD_BITS;
+	static inline std::atomic<ui64> m_subscribedSeries[SUBSCRIBED_SERIES_WORDS] = {};
+	static inline std::atomic<bool> m_isEverySeriesSubscribed = false;
 	static inline Ext::WebSocketServer m_server;
-	static inline std::map<std::string, RecvMessageConfig> m_recvMessageConfigs;
+	static inline std::map<std::string, RecvMessageConfig, std::less<>> m_recvMessageConfigs;
 };
 }
 
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include "Common.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define QD_HAS_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+namespace QD {
+	/*
+	 * Monotonic clock used to timestamp samples at the Plot() call site.
+	 * Now() returns raw ticks, which are either steady_clock ticks or, if enabled and the CPU has an invariant TSC,
+	 * rdtsc cycles. Ticks are converted to microseconds since Start() when a sample is published.
+	 * The TSC frequency is measured against steady_clock at Start() and refined by Calibrate() over the whole runtime.
+	 */
+	class SampleClock {
+	public:
+		/// @brief Sets the zero point of the clock, useTsc is ignored if no invariant TSC is available
+		void Start(bool useTsc) {
+			m_useTsc = useTsc && IsInvariantTscAvailable();
+			m_startSteady = std::chrono::steady_clock::now();
+			m_startTicks = Now();
+			if (!m_useTsc)
+				return;
+
+			// Initial estimate, Calibrate() refines it while the baseline grows
+			auto calibrationEnd = m_startSteady + INITIAL_CALIBRATION_TIME;
+			while (std::chrono::steady_clock::now() < calibrationEnd) {}
+			m_lastCalibration = m_startSteady;
+			Calibrate(true);
+		}
+
+		/// @brief Current time in ticks, cheap enough to be called on every Plot()
+		inline ui64 Now() const {
+#ifdef QD_HAS_TSC
+			if (m_useTsc)
+				return __rdtsc();
+#endif
+			return static_cast<ui64>(std::chrono::steady_clock::now().time_since_epoch().count());
+		}
+
+		/// @brief Converts ticks returned by Now() into microseconds since Start()
+		inline ui64 ToMicroseconds(ui64 ticks) const {
+			auto elapsedTicks = static_cast<i64>(ticks - m_startTicks);
+			if (elapsedTicks <= 0)
+				return 0;
+
+			if (m_useTsc)
+				return static_cast<ui64>(static_cast<f64>(elapsedTicks) * m_microsecondsPerTick.load(std::memory_order_relaxed));
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::duration(elapsedTicks)).count();
+		}
+
+		/// @brief Measures the TSC frequency again, at most once per CALIBRATION_INTERVAL (single thread only)
+		void Calibrate(bool force = false) {
+			if (!m_useTsc)
+				return;
+
+			auto now = std::chrono::steady_clock::now();
+			if (!force && now - m_lastCalibration < CALIBRATION_INTERVAL)
+				return;
+			m_lastCalibration = now;
+
+			auto elapsedUs = std::chrono::duration<f64, std::micro>(now - m_startSteady).count();
+			auto elapsedTicks = static_cast<f64>(Now() - m_startTicks);
+			if (elapsedTicks > 0)
+				m_microsecondsPerTick.store(elapsedUs / elapsedTicks, std::memory_order_relaxed);
+		}
+
+		bool IsUsingTsc() const {
+			return m_useTsc;
+		}
+
+	private:
+		static constexpr std::chrono::milliseconds INITIAL_CALIBRATION_TIME{ 2 };
+		static constexpr std::chrono::seconds CALIBRATION_INTERVAL{ 1 };
+
+		static bool IsInvariantTscAvailable() {
+#ifdef QD_HAS_TSC
+#ifdef _MSC_VER
+			int registers[4];
+			__cpuid(registers, 0x80000000);
+			if (static_cast<unsigned int>(registers[0]) < 0x80000007)
+				return false;
+			__cpuid(registers, 0x80000007);
+			return (registers[3] & (1 << 8)) != 0;
+#else
+			unsigned int eax, ebx, ecx, edx;
+			if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+				return false;
+			return (edx & (1u << 8)) != 0;
+#endif
+#else
+			return false;
+#endif
+		}
+
+		bool m_useTsc = false;
+		ui64 m_startTicks = 0;
+		std::chrono::steady_clock::time_point m_startSteady;
+		std::chrono::steady_clock::time_point m_lastCalibration;
+		std::atomic<f64> m_microsecondsPerTick = 0;
+	};
+}
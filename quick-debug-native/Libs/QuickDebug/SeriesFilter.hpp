@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include "Common.hpp"
+
+namespace QD {
+	/// @brief Changes a client requests for the series it receives, see QuickDebug::OnMessageReceived()
+	enum class SubscriptionAction : ui8 {
+		Connected = 0,		//New clients receive all series
+		Disconnected = 1,
+		Subscribe = 2,		//"QD/Subscribe;name;name..." adds the series
+		Unsubscribe = 3,	//"QD/Unsubscribe;name;name..." removes the series
+		SubscribeOnly = 4,	//"QD/SubscribeOnly;name;name..." only the listed series, also none and no series registered later
+		SubscribeAll = 5,	//"QD/SubscribeAll" all series again, including series registered later
+	};
+
+	/*
+	 * Set of series ids, stored as a bitset. Ids beyond the stored words (e.g. series registered later) are contained
+	 * if IncludesNewSeries() is set, so the default filter contains every series without storing any bits.
+	 */
+	class SeriesFilter {
+	public:
+		static const size_t WORD_BITS = 64;
+
+		bool Contains(ui16 id) const {
+			return (GetWord(id / WORD_BITS) >> (id % WORD_BITS)) & 1;
+		}
+
+		/// @brief Word of the bitset, ids word * 64 to word * 64 + 63
+		ui64 GetWord(size_t word) const {
+			return word < m_words.size() ? m_words[word] : GetFillWord();
+		}
+
+		bool IncludesNewSeries() const {
+			return m_includesNewSeries;
+		}
+
+		/// @brief True if the filter contains every series
+		bool IsAll() const {
+			return m_includesNewSeries && m_words.empty();
+		}
+
+		void Add(ui16 id) {
+			Set(id, true);
+		}
+
+		void Remove(ui16 id) {
+			Set(id, false);
+		}
+
+		/// @brief Contains all series if includeNewSeries is set, otherwise none
+		void Reset(bool includeNewSeries) {
+			m_words.clear();
+			m_includesNewSeries = includeNewSeries;
+		}
+
+		bool operator==(const SeriesFilter& other) const {
+			return m_includesNewSeries == other.m_includesNewSeries && m_words == other.m_words;
+		}
+
+	private:
+		ui64 GetFillWord() const {
+			return m_includesNewSeries ? ~0ull : 0;
+		}
+
+		void Set(ui16 id, bool isContained) {
+			size_t word = id / WORD_BITS;
+			if (word >= m_words.size())
+				m_words.resize(word + 1, GetFillWord());
+
+			ui64 bit = 1ull << (id % WORD_BITS);
+			m_words[word] = isContained ? (m_words[word] | bit) : (m_words[word] & ~bit);
+
+			// Trailing words equal to the fill are implied, so equal filters always compare equal
+			while (!m_words.empty() && m_words.back() == GetFillWord())
+				m_words.pop_back();
+		}
+
+		std::vector<ui64> m_words;
+		bool m_includesNewSeries = true;
+	};
+}
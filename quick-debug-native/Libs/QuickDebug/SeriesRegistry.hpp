@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Common.hpp"
+
+namespace QD {
+	/// @brief 64 bit FNV-1a hash of a series name, usable at compile time
+	constexpr ui64 SeriesHash(std::string_view name) {
+		ui64 hash = 14695981039346656037ull;
+		for (char c : name) {
+			hash ^= static_cast<ui8>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	/// @brief Integer handle of a registered series, obtain one with QuickDebug::RegisterSeries()
+	struct SeriesHandle {
+		static const ui16 INVALID_ID = 0xFFFF;
+
+		ui16 Id = INVALID_ID;
+
+		bool IsValid() const {
+			return Id != INVALID_ID;
+		}
+	};
+
+	/// @brief String literal usable as template argument, the hash of the name is computed at compile time
+	/// Usage: QuickDebug::Plot<"sin">(value);
+	template <size_t N>
+	struct SeriesLiteral {
+		char Name[N];
+		ui64 Hash;
+
+		consteval SeriesLiteral(const char (&name)[N]) : Name(), Hash(SeriesHash(std::string_view(name, N - 1))) {
+			for (size_t i = 0; i < N; ++i)
+				Name[i] = name[i];
+		}
+	};
+
+	/// @brief Thread-safe name <-> id table of all series.
+	/// Registering takes a lock, so handles should be registered once and reused on the hot path.
+	class SeriesRegistry {
+	public:
+		SeriesHandle Register(const char* name) {
+			return Register(name, SeriesHash(name));
+		}
+
+		SeriesHandle Register(std::string_view name, ui64 hash) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			// Probe the following hashes on collisions
+			for (;; ++hash) {
+				auto it = m_idsByHash.find(hash);
+				if (it == m_idsByHash.end())
+					break;
+				if (m_names[it->second] == name)
+					return SeriesHandle{ it->second };
+			}
+
+			if (m_names.size() >= SeriesHandle::INVALID_ID)
+				return SeriesHandle{};
+
+			auto id = static_cast<ui16>(m_names.size());
+			m_names.emplace_back(name);
+			m_idsByHash.emplace(hash, id);
+			return SeriesHandle{ id };
+		}
+
+		/// @brief Handle of a registered series, an invalid handle if no series has the name
+		SeriesHandle Find(std::string_view name) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto hash = SeriesHash(name);; ++hash) {
+				auto it = m_idsByHash.find(hash);
+				if (it == m_idsByHash.end())
+					return SeriesHandle{};
+				if (m_names[it->second] == name)
+					return SeriesHandle{ it->second };
+			}
+		}
+
+		size_t Size() {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_names.size();
+		}
+
+		/// @brief Appends all names that are not yet contained in names, ordered by id
+		void CopyNewNames(std::vector<std::string>& names) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t id = names.size(); id < m_names.size(); ++id)
+				names.push_back(m_names[id]);
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::unordered_map<ui64, ui16> m_idsByHash;
+		std::vector<std::string> m_names;
+	};
+}
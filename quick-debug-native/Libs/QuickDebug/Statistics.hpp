@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
 #include <cstdint>
 #include <iostream>
 #include <fstream>
@@ -33,6 +38,102 @@ namespace QD {
     static inline uint32_t m_ema = 0;
   };
 
+  /// Histogram of latencies in microseconds with fixed memory and logarithmic buckets (like an HDR histogram).
+  /// Values below 64 are counted exactly, larger values in 32 linear buckets per power of two, so percentiles are at most ~3% off.
+  /// Recording is lock-free and can be done from any thread, histograms of several threads or windows are combined with Add().
+  class LatencyHistogram {
+  public:
+    static const uint32_t SUB_BUCKET_BITS = 6;
+    static const uint32_t SUB_BUCKET_HALF = 1u << (SUB_BUCKET_BITS - 1);
+    static const size_t BUCKET_COUNT = (32 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF;
+
+    void Record(uint32_t value) {
+      m_counts[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+      m_count.fetch_add(1, std::memory_order_relaxed);
+
+      uint32_t max = m_max.load(std::memory_order_relaxed);
+      while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    /// Adds the values of the other histogram
+    void Add(const LatencyHistogram& other) {
+      for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        uint32_t count = other.m_counts[i].load(std::memory_order_relaxed);
+        if (count != 0)
+          m_counts[i].fetch_add(count, std::memory_order_relaxed);
+      }
+      m_count.fetch_add(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+      uint32_t otherMax = other.m_max.load(std::memory_order_relaxed);
+      uint32_t max = m_max.load(std::memory_order_relaxed);
+      while (otherMax > max && !m_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed)) {
+      }
+    }
+
+    /// Moves the values into target and clears this histogram, values recorded meanwhile end up in either of them
+    void MoveTo(LatencyHistogram& target) {
+      for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        uint32_t count = m_counts[i].exchange(0, std::memory_order_relaxed);
+        if (count != 0)
+          target.m_counts[i].fetch_add(count, std::memory_order_relaxed);
+      }
+      target.m_count.fetch_add(m_count.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+
+      uint32_t max = m_max.exchange(0, std::memory_order_relaxed);
+      uint32_t targetMax = target.m_max.load(std::memory_order_relaxed);
+      while (max > targetMax && !target.m_max.compare_exchange_weak(targetMax, max, std::memory_order_relaxed)) {
+      }
+    }
+
+    uint64_t GetCount() const {
+      return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint32_t GetMax() const {
+      return m_max.load(std::memory_order_relaxed);
+    }
+
+    /// Returns the value below or equal to which the given percent (0 - 100) of the values are, 0 if the histogram is empty
+    uint32_t GetPercentile(double percent) const {
+      uint64_t count = GetCount();
+      if (count == 0)
+        return 0;
+
+      uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percent / 100.0 * count)));
+      uint64_t seen = 0;
+      for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+          return std::min(GetBucketMax(i), GetMax());
+      }
+      return GetMax();
+    }
+
+  private:
+    static size_t GetBucket(uint32_t value) {
+      if (value < 2 * SUB_BUCKET_HALF)
+        return value;
+
+      // e.g. 100 = 0b1100100: shift 1, bucket 1 * 32 + (100 >> 1) = 82, which holds 100 and 101
+      uint32_t shift = std::bit_width(value) - SUB_BUCKET_BITS;
+      return shift * SUB_BUCKET_HALF + (value >> shift);
+    }
+
+    static uint32_t GetBucketMax(size_t bucket) {
+      if (bucket < 2 * SUB_BUCKET_HALF)
+        return static_cast<uint32_t>(bucket);
+
+      uint32_t shift = static_cast<uint32_t>(bucket / SUB_BUCKET_HALF) - 1;
+      uint64_t first = static_cast<uint64_t>(bucket - shift * SUB_BUCKET_HALF) << shift;
+      return static_cast<uint32_t>(first + (1ull << shift) - 1);
+    }
+
+    std::array<std::atomic<uint32_t>, BUCKET_COUNT> m_counts{};
+    std::atomic<uint64_t> m_count = 0;
+    std::atomic<uint32_t> m_max = 0;
+  };
+
   /// Class that records key-value pairs and writes them to a CSV file.
   /// Format of the CSV file:
   /// key1,key2,key3,...
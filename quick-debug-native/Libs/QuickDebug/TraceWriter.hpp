@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Common/Types.hpp"
+#include "Common/PerThreadBuffers.hpp"
+
+namespace QD {
+	/// @brief Event of a trace file, the name is copied so it does not have to outlive the call
+	struct TraceEvent {
+		static constexpr size_t MAX_NAME_LENGTH = 47;	//Longer names are truncated
+
+		char Phase = 'X';				//'X' slice on the writing thread, 'b'/'e' begin/end of an async slice
+		char Name[MAX_NAME_LENGTH + 1] = {};
+		const char* Category = "";		//Persistent, e.g. a string literal
+		ui64 TimestampUs = 0;			//See TraceWriter::NowUs()
+		ui64 DurationUs = 0;
+		i64 Id = 0;						//Async slices with the same id and name belong together
+		ui32 ThreadId = 0;
+	};
+
+	/*
+	 * Streams events as Chrome Trace Event JSON into a file, which Perfetto (ui.perfetto.dev) and chrome://tracing open as a timeline.
+	 * Timer scopes and LatencyMonitor frames are written while a trace is running.
+	 * Instrumented threads only append events to their own ring buffer, a background thread formats them and writes the file
+	 * in chunks of CHUNK_SIZE bytes, so neither the threads nor the memory depend on the length of the trace.
+	 * Events are dropped (and counted) if a thread's buffer is full.
+	 */
+	class TraceWriter {
+	public:
+		static const size_t EVENT_BUFFER_CAPACITY = 4096;	//Events per thread
+		static const size_t CHUNK_SIZE = 256 * 1024;
+
+		/// @brief Starts writing a trace into the file, returns false if a trace is still running or being saved, or the file can not be opened
+		/// Must not be called concurrently with Stop()
+		static bool Start(const char* filePath) {
+			if (m_isWriting.load(std::memory_order_acquire) || m_isWriterRunning.load(std::memory_order_acquire))
+				return false;
+
+			// Events appended while the previous trace was stopping belong to neither file
+			m_buffers.Discard();
+
+			m_file.open(filePath, std::ios::out | std::ios::trunc | std::ios::binary);
+			if (!m_file.is_open()) {
+				std::cerr << "[QD.TraceWriter] Failed to open file: " << filePath << std::endl;
+				return false;
+			}
+
+			m_filePath = filePath;
+			m_isWriterRunning.store(true, std::memory_order_relaxed);
+			m_isWriting.store(true, std::memory_order_release);
+			std::thread(WriteEvents).detach();
+			return true;
+		}
+
+		/// @brief Writes the remaining events and closes the file
+		static void Stop() {
+			if (!m_isWriting.exchange(false, std::memory_order_acq_rel))
+				return;
+
+			while (m_isWriterRunning.load(std::memory_order_acquire))
+				std::this_thread::sleep_for(POLL_INTERVAL);
+		}
+
+		static bool IsWriting() {
+			return m_isWriting.load(std::memory_order_relaxed);
+		}
+
+		/// @brief Time base of the trace in microseconds (steady_clock)
+		static ui64 NowUs() {
+			return static_cast<ui64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		/// @brief Writes a slice on the timeline of the calling thread, slices of a thread have to be nested
+		static void WriteSlice(std::string_view name, const char* category, ui64 startUs, ui64 durationUs) {
+			TraceEvent event;
+			event.Phase = 'X';
+			event.TimestampUs = startUs;
+			event.DurationUs = durationUs;
+			Append(event, name, category);
+		}
+
+		/// @brief Writes a slice that may overlap others, e.g. the stages of frames in flight, grouped by name and id
+		static void WriteAsyncSlice(std::string_view name, const char* category, i64 id, ui64 startUs, ui64 endUs) {
+			TraceEvent event;
+			event.Phase = 'b';
+			event.TimestampUs = startUs;
+			event.Id = id;
+			Append(event, name, category);
+
+			event.Phase = 'e';
+			event.TimestampUs = std::max(startUs, endUs);
+			Append(event, name, category);
+		}
+
+	private:
+		static constexpr std::chrono::milliseconds POLL_INTERVAL{ 5 };
+
+		static void Append(TraceEvent& event, std::string_view name, const char* category) {
+			if (!IsWriting())
+				return;
+
+			thread_local PerThreadBuffers<TraceEvent>::Handle handle(m_buffers, EVENT_BUFFER_CAPACITY);
+
+			size_t length = std::min(name.size(), TraceEvent::MAX_NAME_LENGTH);
+			std::memcpy(event.Name, name.data(), length);
+			event.Name[length] = '\0';
+			event.Category = category;
+			event.ThreadId = handle->Id;
+
+			TraceEvent copy = event;
+			if (!handle->Items.TryPush(std::move(copy)))
+				handle->CountDropped();
+		}
+
+		// Writer thread, the only reader of the event buffers
+		static void WriteEvents() {
+			std::string chunk;
+			chunk.reserve(CHUNK_SIZE + 1024);
+			chunk += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			bool isFirstEvent = true;
+
+			bool isWriting = true;
+			while (isWriting) {
+				isWriting = m_isWriting.load(std::memory_order_acquire);	//Drains once more after the trace was stopped
+
+				m_buffers.Drain([&](TraceEvent& event) {
+					if (!isFirstEvent)
+						chunk += ",\n";
+					isFirstEvent = false;
+					AppendJson(chunk, event);
+
+					if (chunk.size() >= CHUNK_SIZE) {
+						m_file.write(chunk.data(), chunk.size());
+						chunk.clear();
+					}
+				});
+
+				if (isWriting)
+					std::this_thread::sleep_for(POLL_INTERVAL);
+			}
+
+			ui64 droppedEvents = m_buffers.TakeDroppedCount();
+
+			chunk += "\n]}\n";
+			m_file.write(chunk.data(), chunk.size());
+			m_file.close();
+			std::cout << "[QD.TraceWriter] Saved trace to " << m_filePath << " (" << droppedEvents << " events dropped)" << std::endl;
+
+			m_isWriterRunning.store(false, std::memory_order_release);
+		}
+
+		static void AppendJson(std::string& out, const TraceEvent& event) {
+			char buffer[192];
+			out += "{\"name\":\"";
+			AppendEscaped(out, event.Name);
+			out += "\",\"cat\":\"";
+			AppendEscaped(out, event.Category);
+
+			int length;
+			if (event.Phase == 'X')
+				length = std::snprintf(buffer, sizeof(buffer), "\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u}",
+					static_cast<unsigned long long>(event.TimestampUs), static_cast<unsigned long long>(event.DurationUs), event.ThreadId);
+			else
+				length = std::snprintf(buffer, sizeof(buffer), "\",\"ph\":\"%c\",\"ts\":%llu,\"id\":%lld,\"pid\":1,\"tid\":%u}",
+					event.Phase, static_cast<unsigned long long>(event.TimestampUs), static_cast<long long>(event.Id), event.ThreadId);
+			out.append(buffer, static_cast<size_t>(std::max(length, 0)));
+		}
+
+		static void AppendEscaped(std::string& out, const char* text) {
+			for (; *text != '\0'; ++text) {
+				char c = *text;
+				if (c == '"' || c == '\\') {
+					out += '\\';
+					out += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20)
+					out += ' ';
+				else
+					out += c;
+			}
+		}
+
+		static inline std::atomic<bool> m_isWriting = false;
+		static inline std::atomic<bool> m_isWriterRunning = false;		//Cleared when the detached writer thread closed the file
+		static inline std::ofstream m_file;
+		static inline std::string m_filePath;
+
+		static inline PerThreadBuffers<TraceEvent> m_buffers;		//Drained by the writer thread, or by Start() while none runs. The buffer ids are the thread ids
+	};
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Deflate.hpp"
+
+namespace Ext {
+    // Incremental parser for the frames a WebSocket client sends to the server (RFC 6455)
+    // Received bytes are written into the parser's buffer (PrepareWrite/CommitWrite), Next() then returns one complete
+    // message or control frame at a time. Partial frames stay buffered until the rest arrived, fragmented messages are
+    // reassembled from their continuation frames. Payloads are unmasked in place, so unfragmented messages are never copied.
+    // Messages compressed with permessage-deflate are decompressed once EnableCompression() was called.
+    class WebSocketFrameParser {
+    public:
+        enum class Result {
+            NeedMoreData,   //No complete frame is buffered
+            Message,        //A complete text or binary message, see Opcode() and Payload()
+            Ping,           //Has to be answered with a pong carrying the same payload
+            Pong,
+            Close,          //The client closes the connection, Payload() holds the status code and reason
+            ProtocolError   //The connection has to be closed
+        };
+
+        static const unsigned char OPCODE_CONTINUATION = 0;
+        static const unsigned char OPCODE_TEXT = 1;
+        static const unsigned char OPCODE_BINARY = 2;
+        static const unsigned char OPCODE_CLOSE = 8;
+        static const unsigned char OPCODE_PING = 9;
+        static const unsigned char OPCODE_PONG = 10;
+
+        static const uint64_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+        static const size_t MAX_CONTROL_PAYLOAD_SIZE = 125;
+
+        // Accepts compressed messages (RSV1 set on the first frame), has to be negotiated in the handshake first
+        void EnableCompression() {
+            m_isCompressionEnabled = true;
+        }
+
+        // Returns space for at least size bytes to receive into, consumed bytes are discarded first
+        char* PrepareWrite(size_t size) {
+            if (m_begin == m_end) {
+                m_begin = 0;
+                m_end = 0;
+            }
+            else if (m_begin > 0 && m_buffer.size() - m_end < size) {
+                std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+
+            if (m_buffer.size() - m_end < size)
+                m_buffer.resize(m_end + size);
+            return m_buffer.data() + m_end;
+        }
+
+        // Marks size bytes written into the space returned by PrepareWrite() as received
+        void CommitWrite(size_t size) {
+            m_end += size;
+        }
+
+        // Parses the next frame, the payload of the result stays valid until the next call of Next() or PrepareWrite()
+        Result Next() {
+            while (true) {
+                size_t available = m_end - m_begin;
+                if (available < 2)
+                    return Result::NeedMoreData;
+
+                auto* header = reinterpret_cast<unsigned char*>(m_buffer.data() + m_begin);
+                bool isFinal = (header[0] & 0x80) != 0;
+                unsigned char opcode = header[0] & 0x0F;
+                bool isMasked = (header[1] & 0x80) != 0;    //"All frames sent from client to server have this bit set"
+                uint64_t payloadSize = header[1] & 0x7F;
+                size_t headerSize = 2;
+
+                // RSV1 marks compressed messages, the other reserved bits are not used by any negotiated extension
+                bool isCompressed = (header[0] & 0x40) != 0;
+                if ((header[0] & 0x30) != 0 || (isCompressed && !m_isCompressionEnabled) || !isMasked)
+                    return Result::ProtocolError;
+
+                // Extended payload lengths are transmitted in network byte order (big endian)
+                if (payloadSize == 126) {
+                    headerSize = 4;
+                    if (available < headerSize)
+                        return Result::NeedMoreData;
+                    payloadSize = (static_cast<uint64_t>(header[2]) << 8) | header[3];
+                }
+                else if (payloadSize == 127) {
+                    headerSize = 10;
+                    if (available < headerSize)
+                        return Result::NeedMoreData;
+                    payloadSize = 0;
+                    for (size_t i = 2; i < 10; ++i)
+                        payloadSize = (payloadSize << 8) | header[i];
+                }
+
+                if (payloadSize > MAX_MESSAGE_SIZE)
+                    return Result::ProtocolError;
+
+                const unsigned char* mask = header + headerSize;
+                headerSize += 4;
+                if (available < headerSize + payloadSize)
+                    return Result::NeedMoreData;
+
+                char* payload = m_buffer.data() + m_begin + headerSize;
+                auto size = static_cast<size_t>(payloadSize);
+                Unmask(payload, size, mask);
+                m_begin += headerSize + size;
+
+                // Control frames may be interleaved with the fragments of a message
+                if (opcode >= OPCODE_CLOSE) {
+                    if (!isFinal || size > MAX_CONTROL_PAYLOAD_SIZE || isCompressed)
+                        return Result::ProtocolError;
+
+                    m_payload = std::string_view(payload, size);
+                    switch (opcode) {
+                    case OPCODE_CLOSE: return Result::Close;
+                    case OPCODE_PING: return Result::Ping;
+                    case OPCODE_PONG: return Result::Pong;
+                    default: return Result::ProtocolError;
+                    }
+                }
+
+                if (opcode == OPCODE_CONTINUATION) {
+                    if (!m_isFragmented || isCompressed || m_message.size() + size > MAX_MESSAGE_SIZE)
+                        return Result::ProtocolError;
+
+                    m_message.append(payload, size);
+                    if (!isFinal)
+                        continue;
+
+                    m_isFragmented = false;
+                    return CompleteMessage(m_messageOpcode, m_message, m_isMessageCompressed);
+                }
+
+                if ((opcode != OPCODE_TEXT && opcode != OPCODE_BINARY) || m_isFragmented)
+                    return Result::ProtocolError;
+
+                if (isFinal)
+                    return CompleteMessage(opcode, std::string_view(payload, size), isCompressed);
+
+                // First fragment, the reassembly buffer keeps its capacity between messages
+                m_isFragmented = true;
+                m_isMessageCompressed = isCompressed;
+                m_messageOpcode = opcode;
+                m_message.assign(payload, size);
+            }
+        }
+
+        // Opcode of the last message, OPCODE_TEXT or OPCODE_BINARY
+        unsigned char Opcode() const {
+            return m_opcode;
+        }
+
+        std::string_view Payload() const {
+            return m_payload;
+        }
+
+    private:
+        Result CompleteMessage(unsigned char opcode, std::string_view payload, bool isCompressed) {
+            m_opcode = opcode;
+            m_payload = payload;
+            if (!isCompressed)
+                return Result::Message;
+
+            if (!m_inflater.Inflate(payload, m_inflated, MAX_MESSAGE_SIZE))
+                return Result::ProtocolError;
+            m_payload = m_inflated;
+            return Result::Message;
+        }
+
+        // XORs the payload with the 4 byte masking key, 8 bytes at a time (compilers vectorize the loop further)
+        static void Unmask(char* data, size_t size, const unsigned char* mask) {
+            uint32_t mask32;
+            std::memcpy(&mask32, mask, sizeof(mask32));
+            uint64_t mask64 = (static_cast<uint64_t>(mask32) << 32) | mask32;
+
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+                uint64_t block;
+                std::memcpy(&block, data + i, sizeof(block));
+                block ^= mask64;
+                std::memcpy(data + i, &block, sizeof(block));
+            }
+
+            // i is a multiple of 8 here, so the mask continues with its first byte
+            for (; i < size; ++i)
+                data[i] ^= static_cast<char>(mask[i % 4]);
+        }
+
+        std::vector<char> m_buffer;     //Received bytes, m_begin..m_end are not parsed yet
+        size_t m_begin = 0;
+        size_t m_end = 0;
+
+        std::string m_message;          //Reassembled fragmented message
+        unsigned char m_messageOpcode = OPCODE_TEXT;
+        bool m_isFragmented = false;
+        bool m_isMessageCompressed = false;
+
+        bool m_isCompressionEnabled = false;
+        Inflater m_inflater;
+        std::string m_inflated;         //Decompressed message, keeps its capacity
+
+        std::string_view m_payload;
+        unsigned char m_opcode = OPCODE_TEXT;
+    };
+}
@@ -6,15 +6,27 @@
 #include <thread>
 #include <atomic>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
 #include "Hash/sha1.h"
 #include "Common.hpp"
+#include "Deflate.hpp"
+#include "WebSocketFrameParser.hpp"
 
 
 #ifdef _WIN32
 #include <WinSock2.h>
 #include <WS2tcpip.h>
 #pragma comment(lib, "Ws2_32.lib")
+#define MSG_NOSIGNAL 0 // Windows sockets never raise SIGPIPE
 
 #else
 #include <sys/types.h>
@@ -22,7 +34,11 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
 
 #define SOCKET int
 #define INVALID_SOCKET -1
@@ -31,22 +47,76 @@
 #define SD_BOTH SHUT_RDWR
 #endif
 
+// On Linux epoll reactor threads handle accept, handshake, reads and writes of all clients, each thread owns a share
+// of the connections (see SetIoThreadCount). Other platforms (or QD_DISABLE_EPOLL) use one thread per client.
+#if defined(__linux__) && !defined(QD_DISABLE_EPOLL)
+#define QD_WEBSOCKET_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 
 
 
 namespace Ext {
     class WebSocketServer {
+    public:
+        // Immutable encoded frame (header and payload), shared by the outbound queues of all clients it is sent to
+        using SharedFrame = std::shared_ptr<const std::string>;
+
+        // permessage-deflate variant of a frame, only sent to clients that accept the window it was compressed with
+        struct DeflatedFrame {
+            SharedFrame Frame;
+            int WindowBits;     //Window the frame was compressed with
+        };
+
+        // What happens to droppable frames of a client whose outbound queue exceeds its limit
+        enum class SlowClientPolicy {
+            DropOldest,     //The oldest queued droppable frames are discarded to make room for the new one
+            Downsample,     //Only every n-th droppable frame is queued, n doubles while the queue is full and halves when it drained
+            Disconnect      //The connection is closed
+        };
+
+        struct ClientStats {
+            SOCKET Socket;
+            ui64 DroppedFrames;
+            ui64 DroppedBytes;
+        };
+
+    private:
+        struct OutboundFrame {
+            SharedFrame Frame;
+            bool IsDroppable;
+        };
+
         struct ClientConnection {
             SOCKET Socket;
-            std::thread Thread;
 
             //This is set to true when the WebSocket protocol has established the connection
             //This is not the same as the raw socket establishment
             bool IsWebsocketConnectionEstablished;
+            int DeflateWindowBits = 0;          //Window of the negotiated permessage-deflate, 0 if compressed frames are not sent
+            ui32 Group = 0;                     //Broadcasts to a single group only reach its clients, see SetClientGroup()
+
+            std::deque<OutboundFrame> Outbound; //Encoded frames waiting to be written
+            size_t OutboundOffset = 0;          //Bytes of Outbound.front() that were already written
+            size_t OutboundBytes = 0;           //Total size of all frames in Outbound
+            ui32 DownsampleFactor = 1;          //Only every n-th droppable frame is queued (SlowClientPolicy::Downsample)
+            ui64 DownsampleCounter = 0;
+            ui64 DroppedFrames = 0;
+            ui64 DroppedBytes = 0;
+
+#ifdef QD_WEBSOCKET_EPOLL
+            std::string HandshakeBuffer;        //Collects the HTTP upgrade request until it is complete
+            WebSocketFrameParser Parser;        //Buffers partial frames between reads
+            bool IsWaitingForWritable = false;  //EPOLLOUT is registered because the socket buffer was full
+#else
+            std::mutex WriteMutex;              //Guards the outbound queue and the socket writes of the broadcasting threads
+#endif
         };
 
     public:
-        explicit WebSocketServer() : m_port(0), m_isRunning(false) {
+        WebSocketServer() : m_port(0), m_isRunning(false) {
 #ifdef _WIN32
             WSADATA wsaData;
             int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
@@ -70,8 +140,12 @@ namespace Ext {
 
             m_port = port;
             m_isRunning = true;
+#ifdef QD_WEBSOCKET_EPOLL
+            StartReactor();
+#else
             m_serverThread = std::thread(&WebSocketServer::ServerLoop, this);
             m_serverThread.detach();
+#endif
         }
 
         void Stop() {
@@ -79,6 +153,13 @@ namespace Ext {
                 throw "Server is not running!";
 
             m_isRunning = false;
+#ifdef QD_WEBSOCKET_EPOLL
+            for (auto& shard : m_shards)
+                WakeReactor(*shard);
+            for (auto& thread : m_reactorThreads)
+                thread.join();
+            m_reactorThreads.clear();
+#endif
             if (m_serverThread.joinable())
                 m_serverThread.join();
         }
@@ -87,7 +168,8 @@ namespace Ext {
 			return m_isRunning;
 		}
 
-        void SetMessageHandler(std::function<void(SOCKET, const std::string&)> handler) {
+        // The message passed to the handler is only valid during the call
+        void SetMessageHandler(std::function<void(SOCKET, std::string_view)> handler) {
             m_messageHandler = std::move(handler);
         }
 
@@ -95,66 +177,361 @@ namespace Ext {
             m_onClientConnectedHandler = std::move(handler);
         }
 
-        void SendWebMessage(SOCKET clientSocket, const std::string& message) {
-            struct ControlData {
-			    unsigned char opcode            : 4;
-			    unsigned char rsv3              : 1;
-			    unsigned char rsv2              : 1;
-                unsigned char rsv1              : 1;
-                unsigned char fin               : 1;
-
-			    unsigned char payloadLength     : 7;
-			    unsigned char mask              : 1;
-		    } data;
-
-            data.opcode = 1; // Text message
-            data.fin = 1;    // Has all the data been sent in this frame?
-            data.rsv1 = 0;
-            data.rsv2 = 0;
-            data.rsv3 = 0;
-
-            data.mask = 0;
-            if (message.size() < 126)
-			    data.payloadLength = message.size();
-            else if (message.size() < 65536) {
-			    data.payloadLength = 126; //Indicates that the payload length is 16 bits
-            }
-            else {
-			    data.payloadLength = 127; //Indicates that the payload length is 64 bits
-            }
-
-            SendRaw(clientSocket, (const char*) &data, sizeof(data));
-		    if (data.payloadLength == 126) {
-			    uint16_t length = static_cast<uint16_t>(message.size());
-			    SendRaw(clientSocket, (const char*)&length, sizeof(length));
-		    }
-		    else if (data.payloadLength == 127) {
-			    uint64_t length = message.size();
-			    SendRaw(clientSocket, (const char*)&length, sizeof(length));
-		    }
-
-            SendRaw(clientSocket, message);
+        // Called for every closed connection before its socket is closed
+        void SetClientDisconnectedHandler(std::function<void(SOCKET)> handler) {
+            m_onClientDisconnectedHandler = std::move(handler);
+        }
+
+        // Has to be called before Start().
+        // noDelay disables Nagle's algorithm, cork coalesces bursts of queued frames into full segments (Linux only)
+        void SetTcpOptions(bool noDelay, bool cork) {
+            m_tcpNoDelay = noDelay;
+            m_tcpCork = cork;
+        }
+
+        // Has to be called before Start().
+        // Limits the queued bytes per client, a client that does not read fast enough is handled according to the policy.
+        // 0 disables the limit.
+        void SetOutboundLimit(size_t maxBytes, SlowClientPolicy policy) {
+            m_maxOutboundBytes = maxBytes;
+            m_slowClientPolicy = policy;
+        }
+
+        // Has to be called before Start().
+        // Offers permessage-deflate to clients that support it. level (1-9) trades CPU for ratio,
+        // windowBits (9-15) limits the match distance and the memory of the compressor
+        void SetCompression(bool enabled, int level, int windowBits) {
+            m_isCompressionEnabled = enabled;
+            m_compressionLevel = level;
+            m_compressionWindowBits = std::clamp(windowBits, Deflater::MIN_WINDOW_BITS, Deflater::MAX_WINDOW_BITS);
+            m_deflaterWindowBits = m_compressionWindowBits;
+            m_deflater.Configure(level, m_compressionWindowBits);
+        }
+
+        // Has to be called before Start().
+        // Number of reactor threads the connections are distributed across. Broadcast frames are encoded once and shared
+        // by all threads, so the distribution to many clients scales with the number of cores. Ignored without epoll.
+        void SetIoThreadCount(size_t count) {
+#ifdef QD_WEBSOCKET_EPOLL
+            m_ioThreadCount = std::max<size_t>(1, count);
+#endif
+        }
+
+        // Dropped frame counters of all connected clients, clients that never dropped a frame report 0
+        std::vector<ClientStats> GetClientStats() {
+            std::lock_guard<std::mutex> lock(m_clientStatsMutex);
+            std::vector<ClientStats> stats;
+            stats.reserve(m_clientStats.size());
+            for (auto& [socket, clientStats] : m_clientStats)
+                stats.push_back(clientStats);
+            return stats;
+        }
+
+        static const unsigned char OPCODE_TEXT = 1;
+        static const unsigned char OPCODE_BINARY = 2;
+        static const unsigned char OPCODE_CLOSE = 8;
+        static const unsigned char OPCODE_PING = 9;
+        static const unsigned char OPCODE_PONG = 10;
+
+        static const ui32 ALL_GROUPS = 0xFFFFFFFF;
+
+        // Moves a client into a broadcast group, all clients start in group 0.
+        // Frames broadcast before the call are still sent with the previous group
+        void SetClientGroup(SOCKET clientSocket, ui32 group) {
+#ifdef QD_WEBSOCKET_EPOLL
+            // Applied by the owning reactor thread in order with the queued frames
+            QueueFrame(GetShard(clientSocket), PendingFrame{ clientSocket, nullptr, false, {}, group });
+#else
+            auto clients = m_clients.GetSnapshot();
+            for (auto& client : *clients) {
+                if (client->Socket == clientSocket) {
+                    std::lock_guard<std::mutex> lock(client->WriteMutex);
+                    client->Group = group;
+                }
+            }
+#endif
+        }
+
+        // Messages sent to a single client are never dropped by the slow client policy
+        void SendWebMessage(SOCKET clientSocket, std::string_view message, unsigned char opcode = OPCODE_TEXT) {
+#ifdef QD_WEBSOCKET_EPOLL
+            // The reactor thread owns the sockets, the frame is written when it is writable
+            QueueFrame(clientSocket, CreateFrame(message, opcode), false);
+#else
+            auto clients = m_clients.GetSnapshot();
+            for (auto& client : *clients) {
+                if (client->Socket != clientSocket)
+                    continue;
+
+                std::lock_guard<std::mutex> lock(client->WriteMutex);
+                if (client->IsWebsocketConnectionEstablished) {
+                    EnqueueFrame(*client, CreateFrame(message, opcode), false);
+                    FlushClient(*client);
+                }
+            }
+#endif
 	    }
 
-        void BroadcastMessage(const std::string& message) {
-            for (auto& client : m_activeClients) {
-                if (client.IsWebsocketConnectionEstablished)
-                    SendWebMessage(client.Socket, message);
+        // The frame is encoded exactly once and the same buffer is sent to every client.
+        // Droppable frames (e.g. plot samples) may be discarded for slow clients, all others are always delivered.
+        // A compressed variant is encoded once as well if any client negotiated permessage-deflate.
+        // group limits the broadcast to the clients of one group (see SetClientGroup)
+        void BroadcastMessage(std::string_view message, unsigned char opcode = OPCODE_TEXT, bool isDroppable = false, ui32 group = ALL_GROUPS) {
+            DeflatedFrame compressedFrame{};
+            if (m_deflateClientCount.load(std::memory_order_relaxed) > 0)
+                compressedFrame = CreateCompressedFrame(message, opcode);
+            BroadcastFrame(CreateFrame(message, opcode), isDroppable, compressedFrame, group);
+        }
+
+        // compressedFrame is sent instead of frame to clients with permessage-deflate, if it is set
+        void BroadcastFrame(const SharedFrame& frame, bool isDroppable = false, const DeflatedFrame& compressedFrame = {}, ui32 group = ALL_GROUPS) {
+#ifdef QD_WEBSOCKET_EPOLL
+            QueueFrame(INVALID_SOCKET, frame, isDroppable, compressedFrame, group);
+#else
+            // Sockets are non-blocking, frames the socket does not accept stay queued until the next broadcast.
+            // The client list is a snapshot, connecting and disconnecting clients never wait for a broadcast
+            auto clients = m_clients.GetSnapshot();
+            for (auto& client : *clients) {
+                std::lock_guard<std::mutex> lock(client->WriteMutex);
+                if (!client->IsWebsocketConnectionEstablished || (group != ALL_GROUPS && client->Group != group))
+                    continue;
+                if (EnqueueBroadcastFrame(*client, SelectFrame(*client, frame, compressedFrame), isDroppable))
+                    FlushClient(*client);
+                else
+                    DisconnectClient(*client);
 			}
+#endif
+        }
+
+        static SharedFrame CreateFrame(std::string_view message, unsigned char opcode = OPCODE_TEXT) {
+            return std::make_shared<const std::string>(EncodeFrame(message, opcode));
+        }
+
+        // Returns the permessage-deflate frame of the message, its Frame is nullptr if compression does not make it smaller.
+        // The frame is shared by all clients, so it is compressed with the smallest window any connected client accepts
+        DeflatedFrame CreateCompressedFrame(std::string_view message, unsigned char opcode = OPCODE_TEXT) {
+            if (message.size() < MIN_COMPRESSED_MESSAGE_SIZE)
+                return {};
+
+            // Broadcasts may come from multiple threads, the compressor and its buffers are shared
+            std::lock_guard<std::mutex> lock(m_deflaterMutex);
+            int windowBits = GetSharedWindowBits();
+            if (windowBits != m_deflaterWindowBits) {
+                m_deflater.Configure(m_compressionLevel, windowBits);
+                m_deflaterWindowBits = windowBits;
+            }
+
+            m_deflater.Compress(message, m_compressedMessage);
+            if (m_compressedMessage.size() >= message.size())
+                return {};
+
+            auto frame = EncodeFrame(m_compressedMessage, opcode);
+            frame[0] |= FRAME_RSV1;
+            return { std::make_shared<const std::string>(std::move(frame)), windowBits };
+        }
+
+        void BroadcastBinaryMessage(std::string_view message, bool isDroppable = false, ui32 group = ALL_GROUPS) {
+            BroadcastMessage(message, OPCODE_BINARY, isDroppable, group);
         }
 
 
     private:
-        void SendRaw(SOCKET client_socket, const std::string& message) {
-             send(client_socket, message.c_str(), strlen(message.c_str()), 0);
+        static constexpr ui32 MAX_DOWNSAMPLE_FACTOR = 64;
+        static const size_t MIN_COMPRESSED_MESSAGE_SIZE = 64;  //Smaller messages are always sent uncompressed
+        static const char FRAME_RSV1 = 0x40;                   //Marks compressed messages
+
+        // A client connecting during a broadcast may accept a smaller window than the compressed frame was made for
+        static const SharedFrame& SelectFrame(const ClientConnection& client, const SharedFrame& frame, const DeflatedFrame& compressedFrame) {
+            bool isCompressedAccepted = compressedFrame.Frame && client.DeflateWindowBits >= compressedFrame.WindowBits;
+            return isCompressedAccepted ? compressedFrame.Frame : frame;
         }
 
-        void SendRaw(SOCKET client_socket, const std::vector<char>& data) {
-            send(client_socket, data.data(), static_cast<int>(data.size()), 0);
+        void AddDeflateClient(int windowBits) {
+            m_deflateWindowClientCounts[windowBits]++;
+            m_deflateClientCount++;
         }
 
-        void SendRaw(SOCKET client_socket, const char* data, int length) {
-            send(client_socket, data, length, 0);
+        void RemoveDeflateClient(int windowBits) {
+            m_deflateWindowClientCounts[windowBits]--;
+            m_deflateClientCount--;
+        }
+
+        // Smallest window of the connected clients with permessage-deflate, at most the configured window
+        int GetSharedWindowBits() {
+            for (int windowBits = Deflater::MIN_WINDOW_BITS; windowBits < m_compressionWindowBits; ++windowBits) {
+                if (m_deflateWindowClientCounts[windowBits].load(std::memory_order_relaxed) > 0)
+                    return windowBits;
+            }
+            return m_compressionWindowBits;
+        }
+
+        // Appends a frame without applying the slow client policy
+        static void EnqueueFrame(ClientConnection& client, SharedFrame frame, bool isDroppable) {
+            client.OutboundBytes += frame->size();
+            client.Outbound.push_back(OutboundFrame{ std::move(frame), isDroppable });
+        }
+
+        // Appends a broadcast frame according to the slow client policy, returns false if the client has to be disconnected
+        bool EnqueueBroadcastFrame(ClientConnection& client, const SharedFrame& frame, bool isDroppable) {
+            if (m_maxOutboundBytes == 0 || !isDroppable) {
+                EnqueueFrame(client, frame, isDroppable);
+                return true;
+            }
+
+            if (client.DownsampleFactor > 1 && client.DownsampleCounter++ % client.DownsampleFactor != 0) {
+                CountDroppedFrame(client, frame->size());
+                return true;
+            }
+
+            if (client.OutboundBytes + frame->size() > m_maxOutboundBytes) {
+                switch (m_slowClientPolicy) {
+                case SlowClientPolicy::Disconnect:
+                    DEBUG_PRINT("[WebSocketServer] Socket %llu: Outbound limit exceeded, disconnecting\n", static_cast<ui64>(client.Socket));
+                    return false;
+
+                case SlowClientPolicy::Downsample:
+                    client.DownsampleFactor = std::min(client.DownsampleFactor * 2, MAX_DOWNSAMPLE_FACTOR);
+                    CountDroppedFrame(client, frame->size());
+                    return true;
+
+                case SlowClientPolicy::DropOldest:
+                    // A partially written frame has to be completed, otherwise the stream is corrupted
+                    for (auto it = client.Outbound.begin() + (client.OutboundOffset > 0 ? 1 : 0);
+                         it != client.Outbound.end() && client.OutboundBytes + frame->size() > m_maxOutboundBytes;) {
+                        if (!it->IsDroppable) {
+                            ++it;
+                            continue;
+                        }
+                        client.OutboundBytes -= it->Frame->size();
+                        CountDroppedFrame(client, it->Frame->size());
+                        it = client.Outbound.erase(it);
+                    }
+
+                    if (client.OutboundBytes + frame->size() > m_maxOutboundBytes) {
+                        CountDroppedFrame(client, frame->size());
+                        return true;
+                    }
+                    break;
+                }
+            }
+
+            EnqueueFrame(client, frame, isDroppable);
+            return true;
+        }
+
+        // Called when the WebSocket connection is established, so GetClientStats() lists every connected client
+        void AddClientStats(SOCKET clientSocket) {
+            std::lock_guard<std::mutex> lock(m_clientStatsMutex);
+            m_clientStats[clientSocket] = ClientStats{ clientSocket, 0, 0 };
+        }
+
+        void CountDroppedFrame(ClientConnection& client, size_t size) {
+            client.DroppedFrames++;
+            client.DroppedBytes += size;
+
+            std::lock_guard<std::mutex> lock(m_clientStatsMutex);
+            m_clientStats[client.Socket] = ClientStats{ client.Socket, client.DroppedFrames, client.DroppedBytes };
+        }
+
+        void RemoveClientStats(SOCKET clientSocket) {
+            std::lock_guard<std::mutex> lock(m_clientStatsMutex);
+            m_clientStats.erase(clientSocket);
+        }
+
+        // Writes as much of the outbound queue as the socket accepts, returns false if the connection failed.
+        // Up to MAX_WRITE_BATCH queued frames are gathered into a single call (WSASend on Windows, sendmsg elsewhere).
+        // isBlocked is set if the socket buffer is full and frames are left in the queue.
+        bool WriteOutbound(ClientConnection& client, bool& isBlocked) {
+            static const size_t MAX_WRITE_BATCH = 64;
+#ifdef _WIN32
+            WSABUF buffers[MAX_WRITE_BATCH];
+#else
+            iovec buffers[MAX_WRITE_BATCH];
+#endif
+
+            isBlocked = false;
+            while (!client.Outbound.empty()) {
+                size_t bufferCount = 0;
+                for (auto it = client.Outbound.begin(); it != client.Outbound.end() && bufferCount < MAX_WRITE_BATCH; ++it, ++bufferCount) {
+                    size_t offset = bufferCount == 0 ? client.OutboundOffset : 0;
+#ifdef _WIN32
+                    buffers[bufferCount].buf = const_cast<char*>(it->Frame->data() + offset);
+                    buffers[bufferCount].len = static_cast<ULONG>(it->Frame->size() - offset);
+#else
+                    buffers[bufferCount].iov_base = const_cast<char*>(it->Frame->data() + offset);
+                    buffers[bufferCount].iov_len = it->Frame->size() - offset;
+#endif
+                }
+
+#ifdef _WIN32
+                DWORD bytesSent = 0;
+                if (WSASend(client.Socket, buffers, static_cast<DWORD>(bufferCount), &bytesSent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+                    if (WSAGetLastError() != WSAEWOULDBLOCK)
+                        return false;
+
+                    isBlocked = true;
+                    return true;
+                }
+                size_t written = bytesSent;
+#else
+                msghdr msg{};
+                msg.msg_iov = buffers;
+                msg.msg_iovlen = bufferCount;
+
+                // With TCP_CORK behaviour enabled, writes that are followed by more queued frames are marked with MSG_MORE,
+                // so the kernel only emits full segments until the last write of the burst
+                int flags = MSG_NOSIGNAL;
+#ifdef MSG_MORE
+                if (m_tcpCork && client.Outbound.size() > bufferCount)
+                    flags |= MSG_MORE;
+#endif
+
+                auto result = sendmsg(client.Socket, &msg, flags);
+                if (result < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        return false;
+
+                    isBlocked = true;
+                    return true;
+                }
+                size_t written = static_cast<size_t>(result);
+#endif
+
+                // Drop all completely written frames
+                while (written > 0) {
+                    size_t frameRemaining = client.Outbound.front().Frame->size() - client.OutboundOffset;
+                    if (written < frameRemaining) {
+                        client.OutboundOffset += written;
+                        break;
+                    }
+
+                    written -= frameRemaining;
+                    client.OutboundBytes -= client.Outbound.front().Frame->size();
+                    client.Outbound.pop_front();
+                    client.OutboundOffset = 0;
+                }
+
+                // The client caught up, halve the downsampling
+                if (client.DownsampleFactor > 1 && client.OutboundBytes < m_maxOutboundBytes / 2)
+                    client.DownsampleFactor /= 2;
+            }
+            return true;
+        }
+
+        static void SetNonBlocking(SOCKET socket) {
+#ifdef _WIN32
+            u_long mode = 1;
+            ioctlsocket(socket, FIONBIO, &mode);
+#else
+            fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+        }
+
+        void ApplySocketOptions(SOCKET socket) {
+            int noDelay = m_tcpNoDelay ? 1 : 0;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
         }
 
         int GetLastErrror() {
@@ -165,15 +542,16 @@ namespace Ext {
 #endif
         }
 
+        // Would-block results of the non-blocking client sockets are no errors
         bool IsError(int errorCode) {
 #ifdef _WIN32
-            return errorCode == WSAEWOULDBLOCK || errorCode == WSAECONNRESET || errorCode == WSAECONNABORTED;
+            return errorCode == WSAECONNRESET || errorCode == WSAECONNABORTED;
 #else
-            return errorCode != 0;
+            return errorCode != 0 && errorCode != EAGAIN && errorCode != EWOULDBLOCK && errorCode != EINTR;
 #endif
         }
 
-        void ServerLoop() {
+        SOCKET CreateListenSocket() {
             struct addrinfo hints, * result = nullptr;
             std::memset(&hints, 0, sizeof(hints));
             hints.ai_family = AF_INET; // IPv4
@@ -202,13 +580,20 @@ namespace Ext {
 
             freeaddrinfo(result);
 
-            result_val = listen(listenSocket, 3);
+            result_val = listen(listenSocket, SOMAXCONN);    //Clients reconnecting at once must not overflow the backlog
             if (result_val == SOCKET_ERROR) {
                 throw "[WebSocketServer] Socket listen failed with error: " + GetLastErrror();
                 closesocket(listenSocket);
-                return;
+                return INVALID_SOCKET;
             }
             DEBUG_PRINT("[WebSocketServer] Listening on port " PRINT_INT64 PRINT_STRING, m_port, "\r\n");
+            return listenSocket;
+        }
+
+#ifndef QD_WEBSOCKET_EPOLL
+        void ServerLoop() {
+            SOCKET listenSocket = CreateListenSocket();
+            int result_val;
 
             while (m_isRunning) {
                 fd_set readfds;
@@ -233,13 +618,14 @@ namespace Ext {
                         throw "[WebSocketServer] Incoming connection accept failed: " + std::to_string(GetLastErrror());
                     }
                     DEBUG_PRINT("[WebSocketServer] Client connected on port %d\r\n", m_port);
+                    ApplySocketOptions(clientSocket);
 
-                    auto& client = m_activeClients.emplace_back();
-                    client.Socket = clientSocket;
-                    client.IsWebsocketConnectionEstablished = false;
+                    // The client thread shares the ownership, the client is registered for broadcasts after the handshake
+                    auto client = std::make_shared<ClientConnection>();
+                    client->Socket = clientSocket;
+                    client->IsWebsocketConnectionEstablished = false;
 
-                    client.Thread = std::thread(&WebSocketServer::ClientLoop, this, &client);
-                    client.Thread.detach(); // Detach the thread, let it run freely
+                    std::thread(&WebSocketServer::ClientLoop, this, std::move(client)).detach(); // Detach the thread, let it run freely
                 }
             }
 
@@ -262,8 +648,9 @@ namespace Ext {
         }
 
 
-        void ClientLoop(ClientConnection* client) {
-            char buffer[4096] = { 0 };
+        void ClientLoop(std::shared_ptr<ClientConnection> client) {
+            WebSocketFrameParser parser;
+            bool isNegotiated = false;
             int bytesRead;
             SOCKET clientSocket = client->Socket;
 
@@ -278,98 +665,135 @@ namespace Ext {
                 FD_ZERO(&readfds);
                 FD_SET(clientSocket, &readfds);
 
+                // Frames the socket did not accept during a broadcast are written here as soon as it is writable again
+                fd_set writefds;
+                FD_ZERO(&writefds);
+                if (HasOutbound(*client))
+                    FD_SET(clientSocket, &writefds);
+
+                // Frames may be left over by a broadcast while this thread waits, so the wait is kept short
                 timeval timeout;
-                timeout.tv_sec = 1;
-                timeout.tv_usec = 0;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = OUTBOUND_POLL_INTERVAL_US;
 
 #ifdef _WIN32
                 const int maxFd = 0;
 #else
                 const int maxFd = clientSocket + 1;
 #endif
-                auto result_val = select(maxFd, &readfds, nullptr, nullptr, &timeout);
-                if (result_val <= 0 || !FD_ISSET(clientSocket, &readfds)) {
-                    DEBUG_PRINT("[WebSocketServer] Socket %llu: Timeout", static_cast<ui64>(clientSocket));
-                    continue;
+                auto result_val = select(maxFd, &readfds, &writefds, nullptr, &timeout);
+                if (result_val > 0 && FD_ISSET(clientSocket, &writefds)) {
+                    std::lock_guard<std::mutex> lock(client->WriteMutex);
+                    if (client->IsWebsocketConnectionEstablished)
+                        FlushClient(*client);
                 }
+                if (result_val <= 0 || !FD_ISSET(clientSocket, &readfds))
+                    continue;
 
                 DEBUG_PRINT("[WebSocketServer] Socket %llu: recv", static_cast<ui64>(clientSocket));
-                if ((bytesRead = recv(clientSocket, buffer, sizeof(buffer), 0)) <= 0)
+                char* buffer = parser.PrepareWrite(RECV_BUFFER_SIZE);
+                bytesRead = recv(clientSocket, buffer, static_cast<int>(RECV_BUFFER_SIZE), 0);
+                if (bytesRead == SOCKET_ERROR && !IsError(GetLastErrror()))
+                    continue;
+                if (bytesRead <= 0)
                 {
                     break;
                 }
 
-                if (!client->IsWebsocketConnectionEstablished) {
+                if (!isNegotiated) {
                     DEBUG_PRINT("[WebSocketServer] Socket %llu: Negotiating connection...\n", static_cast<ui64>(clientSocket));
 
-                    NegotiateConnection(clientSocket, buffer, bytesRead);
+                    client->DeflateWindowBits = NegotiateConnection(clientSocket, buffer, bytesRead);
+                    if (client->DeflateWindowBits > 0)
+                        parser.EnableCompression();
 
+                    // Frames are written by the broadcasting thread, which must never block on a slow client
+                    SetNonBlocking(clientSocket);
                     client->IsWebsocketConnectionEstablished = true;
+                    isNegotiated = true;
+                    AddClientStats(clientSocket);
+                    m_clients.Add(client);
                     if (m_onClientConnectedHandler)
                         m_onClientConnectedHandler(clientSocket);
                     continue;
                 }
 
-                auto mask = (buffer[1] & 0b10000000) != 0;  // must be true, "All messages from the client to the server have this bit set"
-                int opcode = buffer[0] & 0b00001111;        // expecting 1 - text message
-                int offset = 2;
-                uint64_t msglen = buffer[1] & (uint64_t)0b01111111;
-
-                if (msglen == 126) {
-                    // bytes are reversed because websocket will print them in Big-Endian, whereas
-                    // BitConverter will want them arranged in little-endian on windows
-                    char msgLengthReversed[2] = { buffer[3], buffer[2] };
-
-                    msglen = *(uint16_t*)(msgLengthReversed);
-                    offset = 4;
-                }
-                else if (msglen == 127) {
-                    // To test the below code, we need to manually buffer larger messages — since the NIC's autobuffering
-                    // may be too latency-friendly for this code to run (that is, we may have only some of the bytes in this
-                    // websocket frame available through client.Available).
-                    char msgLengthReversed[8] = { buffer[9], buffer[8], buffer[7], buffer[6], buffer[5], buffer[4], buffer[3], buffer[2] };
-                    msglen = *(uint64_t*)(msgLengthReversed);
-                    offset = 10;
+                parser.CommitWrite(bytesRead);
+                bool isOpen = HandleFrames(clientSocket, parser, [&](std::string_view payload, unsigned char opcode) {
+                    SendWebMessage(clientSocket, payload, opcode);
+                });
+                if (!isOpen) {
+                    DrainOutbound(*client);     //E.g. the reply to a close frame
+                    break;
                 }
+            }
 
-                if (msglen == 0) {
-                    DEBUG_PRINT("[WebSocketServer] Socket %llu : Empty message received. Ignoring message.", static_cast<ui64>(clientSocket));
-                    continue;
-                }
+            CleanupClientSocket(client);
+        }
 
-                if (!mask) {
-                    DEBUG_PRINT("[WebSocketServer] Socket %llu : Mask bit not set. Ignoring message.", static_cast<ui64>(clientSocket));
-                    continue;
-                }
+        bool HasOutbound(ClientConnection& client) {
+            std::lock_guard<std::mutex> lock(client.WriteMutex);
+            return client.IsWebsocketConnectionEstablished && !client.Outbound.empty();
+        }
 
-                char* decoded = new char[msglen+1];
-                char masks[4] = { buffer[offset], buffer[offset + 1], buffer[offset + 2], buffer[offset + 3] };
-                offset += 4;
+        // Waits up to DRAIN_TIMEOUT_MS until the queued frames are written, before the connection is closed
+        void DrainOutbound(ClientConnection& client) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+            while (HasOutbound(client) && std::chrono::steady_clock::now() < deadline) {
+                fd_set writefds;
+                FD_ZERO(&writefds);
+                FD_SET(client.Socket, &writefds);
 
-                //Decode message
-                for (auto i = 0; i < msglen; ++i) {
-                    decoded[i] = buffer[offset + i] ^ masks[i % 4];
-                }
-                decoded[msglen] = '\0';     //C++ string terminator
+                timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = OUTBOUND_POLL_INTERVAL_US;
 
-                std::string message(decoded);
-                if (m_messageHandler)
-                    m_messageHandler(clientSocket, message);
+#ifdef _WIN32
+                const int maxFd = 0;
+#else
+                const int maxFd = client.Socket + 1;
+#endif
+                if (select(maxFd, nullptr, &writefds, nullptr, &timeout) <= 0)
+                    continue;
 
-                delete[] decoded;
+                std::lock_guard<std::mutex> lock(client.WriteMutex);
+                if (client.IsWebsocketConnectionEstablished)
+                    FlushClient(client);
             }
+        }
 
-            CleanupClientSocket(clientSocket);
+        // Writes the queued frames of a client, the connection is shut down if the write failed
+        void FlushClient(ClientConnection& client) {
+            bool isBlocked;
+            if (!WriteOutbound(client, isBlocked))
+                DisconnectClient(client);
         }
 
-        inline void CleanupClientSocket(SOCKET clientSocket) {
+        // The client loop notices the closed socket and cleans it up
+        void DisconnectClient(ClientConnection& client) {
+            client.IsWebsocketConnectionEstablished = false;
+            client.Outbound.clear();
+            shutdown(client.Socket, SD_BOTH);
+        }
+
+        inline void CleanupClientSocket(const std::shared_ptr<ClientConnection>& client) {
+            SOCKET clientSocket = client->Socket;
             DEBUG_PRINT("[WebSocketServer] Socket %llu: Cleaning up data\n", static_cast<ui64>(clientSocket));
 
-            m_activeClients.erase(std::remove_if(m_activeClients.begin(), m_activeClients.end(), [clientSocket](const ClientConnection& client) {
-                return client.Socket == clientSocket;
-            }), m_activeClients.end());
+            m_clients.Remove(client);
+            {
+                // Broadcasts still iterating an older snapshot skip the client, so the socket is never written after it is closed
+                std::lock_guard<std::mutex> lock(client->WriteMutex);
+                client->IsWebsocketConnectionEstablished = false;
+                client->Outbound.clear();
+            }
+            RemoveClientStats(clientSocket);
+            if (client->DeflateWindowBits > 0)
+                RemoveDeflateClient(client->DeflateWindowBits);
+            if (m_onClientDisconnectedHandler)
+                m_onClientDisconnectedHandler(clientSocket);
 
-            DEBUG_PRINT("[WebSocketServer] Active clients: %llu\n", m_activeClients.size());
+            DEBUG_PRINT("[WebSocketServer] Active clients: %llu\n", static_cast<ui64>(m_clients.Size()));
 
             auto result = shutdown(clientSocket, SD_BOTH);
             if (result == SOCKET_ERROR) {
@@ -381,12 +805,440 @@ namespace Ext {
                 DEBUG_PRINT("[WebSocketServer] Socket %llu: closesocket failed\n", static_cast<ui64>(clientSocket));
             }
         }
+#endif
+
+        static const size_t RECV_BUFFER_SIZE = 4096;
+        static const size_t MAX_HANDSHAKE_SIZE = 8192;     //Connections whose upgrade request is not complete within this size are closed
+#ifndef QD_WEBSOCKET_EPOLL
+        static const long OUTBOUND_POLL_INTERVAL_US = 100000;  //Longest time frames left over by a broadcast wait to be written
+        static const int DRAIN_TIMEOUT_MS = 1000;
+#endif
+
+        // Handles all complete frames buffered in the parser, text messages are forwarded to the message handler.
+        // Control frames are answered through reply(payload, opcode). Returns false if the connection has to be closed
+        template <typename Reply>
+        bool HandleFrames(SOCKET clientSocket, WebSocketFrameParser& parser, Reply&& reply) {
+            while (true) {
+                switch (parser.Next()) {
+                case WebSocketFrameParser::Result::NeedMoreData:
+                    return true;
+                case WebSocketFrameParser::Result::Message:
+                    if (parser.Opcode() == OPCODE_TEXT && m_messageHandler)
+                        m_messageHandler(clientSocket, parser.Payload());
+                    break;
+                case WebSocketFrameParser::Result::Ping:
+                    reply(parser.Payload(), OPCODE_PONG);
+                    break;
+                case WebSocketFrameParser::Result::Pong:
+                    break;
+                case WebSocketFrameParser::Result::Close:
+                    // The close frame is echoed with the status code of the client
+                    reply(parser.Payload().substr(0, 2), OPCODE_CLOSE);
+                    DEBUG_PRINT("[WebSocketServer] Socket %llu: Close frame received\n", static_cast<ui64>(clientSocket));
+                    return false;
+                case WebSocketFrameParser::Result::ProtocolError:
+                    DEBUG_PRINT("[WebSocketServer] Socket %llu: Invalid frame received, closing connection\n", static_cast<ui64>(clientSocket));
+                    return false;
+                }
+            }
+        }
+
+        static const size_t MAX_FRAME_HEADER_SIZE = 10;
+
+        // Writes the header of an unmasked server frame, returns the header size
+        static size_t EncodeFrameHeader(uint64_t size, unsigned char opcode, char* header) {
+            header[0] = static_cast<char>(0x80 | opcode); // FIN bit + opcode
+
+            // Extended payload lengths are transmitted in network byte order (big endian)
+            if (size < 126) {
+                header[1] = static_cast<char>(size);
+                return 2;
+            }
+            if (size < 65536) {
+                header[1] = 126;
+                header[2] = static_cast<char>((size >> 8) & 0xFF);
+                header[3] = static_cast<char>(size & 0xFF);
+                return 4;
+            }
+
+            header[1] = 127;
+            for (int i = 9; i >= 2; --i, size >>= 8)
+                header[i] = static_cast<char>(size & 0xFF);
+            return 10;
+        }
+
+        // Encodes a complete unmasked server frame (header and payload) into one buffer
+        static std::string EncodeFrame(std::string_view message, unsigned char opcode) {
+            char header[MAX_FRAME_HEADER_SIZE];
+            auto headerSize = EncodeFrameHeader(message.size(), opcode, header);
+
+            std::string frame;
+            frame.reserve(headerSize + message.size());
+            frame.append(header, headerSize);
+            frame.append(message);
+            return frame;
+        }
+
+#ifdef QD_WEBSOCKET_EPOLL
+        #pragma region Reactor
+        struct PendingFrame {
+            SOCKET Target;      //INVALID_SOCKET broadcasts the frame to all established connections
+            SharedFrame Frame;
+            bool IsDroppable;
+            DeflatedFrame CompressedFrame;  //Optional, sent to clients with permessage-deflate
+            ui32 Group = ALL_GROUPS;        //Broadcasts only: group of the receiving clients. Moves Target into the group if Frame is not set
+        };
+
+        // One I/O thread with its own epoll instance and the clients assigned to it (socket % shard count).
+        // Only the thread of the shard touches its clients, other threads hand over frames and sockets through the pending lists.
+        // The descriptors are closed with the shard, i.e. on the next Start() or destruction of the server, so publishers
+        // that still wake the shard after Stop() write into its own eventfd instead of a reused descriptor.
+        struct ReactorShard {
+            int EpollFd = -1;
+            int WakeFd = -1;
+            std::unordered_map<SOCKET, ClientConnection> Clients;
+            std::vector<PendingFrame> DistributingFrames;
+            std::vector<SOCKET> AdoptingSockets;
+
+            std::mutex PendingMutex;
+            std::vector<PendingFrame> PendingFrames;
+            std::vector<SOCKET> AcceptedSockets;    //Accepted by the listening shard, not registered yet
+
+            ~ReactorShard() {
+                if (WakeFd >= 0)
+                    close(WakeFd);
+                if (EpollFd >= 0)
+                    close(EpollFd);
+            }
+        };
+
+        void StartReactor() {
+            m_shards.clear();
+            for (size_t i = 0; i < m_ioThreadCount; ++i) {
+                auto shard = std::make_unique<ReactorShard>();
+                shard->EpollFd = epoll_create1(EPOLL_CLOEXEC);
+                shard->WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (shard->EpollFd < 0 || shard->WakeFd < 0)
+                    throw "[WebSocketServer] epoll setup failed with error: " + std::to_string(GetLastErrror());
+
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = shard->WakeFd;
+                epoll_ctl(shard->EpollFd, EPOLL_CTL_ADD, shard->WakeFd, &ev);
+                m_shards.push_back(std::move(shard));
+            }
+
+            // The first shard also accepts connections, Stop() joins all threads
+            for (size_t i = 0; i < m_shards.size(); ++i)
+                m_reactorThreads.emplace_back(&WebSocketServer::ReactorLoop, this, m_shards[i].get(), i == 0);
+        }
+
+        ReactorShard& GetShard(SOCKET socket) {
+            return *m_shards[static_cast<size_t>(socket) % m_shards.size()];
+        }
+
+        // Hands a frame over to the reactor threads, a shard is only woken up if it has no pending frames yet.
+        // Broadcasts are queued on every shard, each shard distributes the shared frame to its own clients.
+        void QueueFrame(SOCKET target, SharedFrame frame, bool isDroppable, DeflatedFrame compressedFrame = {}, ui32 group = ALL_GROUPS) {
+            if (target != INVALID_SOCKET) {
+                QueueFrame(GetShard(target), PendingFrame{ target, std::move(frame), isDroppable, std::move(compressedFrame), group });
+                return;
+            }
+
+            for (auto& shard : m_shards)
+                QueueFrame(*shard, PendingFrame{ target, frame, isDroppable, compressedFrame, group });
+        }
+
+        void QueueFrame(ReactorShard& shard, PendingFrame pending) {
+            bool wasEmpty;
+            {
+                std::lock_guard<std::mutex> lock(shard.PendingMutex);
+                wasEmpty = shard.PendingFrames.empty() && shard.AcceptedSockets.empty();
+                shard.PendingFrames.push_back(std::move(pending));
+            }
+
+            if (wasEmpty)
+                WakeReactor(shard);
+        }
+
+        void WakeReactor(ReactorShard& shard) {
+            uint64_t one = 1;
+            if (shard.WakeFd >= 0)
+                write(shard.WakeFd, &one, sizeof(one));
+        }
+
+        void ReactorLoop(ReactorShard* shard, bool isListening) {
+            SOCKET listenSocket = INVALID_SOCKET;
+            if (isListening) {
+                listenSocket = CreateListenSocket();
+                SetNonBlocking(listenSocket);
+
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = listenSocket;
+                epoll_ctl(shard->EpollFd, EPOLL_CTL_ADD, listenSocket, &ev);
+            }
+
+            std::vector<SOCKET> closedSockets;
+            epoll_event events[64];
+            while (m_isRunning) {
+                int eventCount = epoll_wait(shard->EpollFd, events, 64, 1000);
+                for (int i = 0; i < eventCount; ++i) {
+                    int fd = events[i].data.fd;
+                    if (fd == listenSocket) {
+                        AcceptClients(*shard, listenSocket);
+                        continue;
+                    }
+                    if (fd == shard->WakeFd) {
+                        uint64_t count;
+                        read(shard->WakeFd, &count, sizeof(count));
+                        DistributePendingFrames(*shard, closedSockets);
+                        continue;
+                    }
+
+                    auto it = shard->Clients.find(fd);
+                    if (it == shard->Clients.end())
+                        continue;
+
+                    auto& client = it->second;
+                    bool isOpen = true;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                        isOpen = ReadClient(*shard, client);
+                    if (isOpen && (events[i].events & EPOLLOUT))
+                        isOpen = WriteClient(*shard, client);
+                    if (!isOpen)
+                        closedSockets.push_back(fd);
+                }
+
+                for (auto socket : closedSockets)
+                    CloseReactorClient(*shard, socket);
+                closedSockets.clear();
+            }
+
+            for (auto& [socket, client] : shard->Clients)
+                closesocket(socket);
+            shard->Clients.clear();
+
+            {
+                // Sockets accepted for this shard during shutdown
+                std::lock_guard<std::mutex> lock(shard->PendingMutex);
+                for (auto socket : shard->AcceptedSockets)
+                    closesocket(socket);
+                shard->AcceptedSockets.clear();
+            }
+
+            if (isListening) {
+                DEBUG_PRINT_NOARGS("[WebSocketServer] Listening stopped");
+                closesocket(listenSocket);
+            }
+        }
+
+        void AcceptClients(ReactorShard& shard, SOCKET listenSocket) {
+            while (true) {
+                SOCKET clientSocket = accept(listenSocket, nullptr, nullptr);
+                if (clientSocket == INVALID_SOCKET)
+                    return; // EAGAIN: all pending connections are accepted
+
+                DEBUG_PRINT("[WebSocketServer] Client connected on port %d\r\n", m_port);
+                SetNonBlocking(clientSocket);
+                ApplySocketOptions(clientSocket);
+
+                auto& owner = GetShard(clientSocket);
+                if (&owner == &shard) {
+                    AddReactorClient(shard, clientSocket);
+                    continue;
+                }
+
+                bool wasEmpty;
+                {
+                    std::lock_guard<std::mutex> lock(owner.PendingMutex);
+                    wasEmpty = owner.PendingFrames.empty() && owner.AcceptedSockets.empty();
+                    owner.AcceptedSockets.push_back(clientSocket);
+                }
+                if (wasEmpty)
+                    WakeReactor(owner);
+            }
+        }
+
+        void AddReactorClient(ReactorShard& shard, SOCKET clientSocket) {
+            auto& client = shard.Clients[clientSocket];
+            client.Socket = clientSocket;
+            client.IsWebsocketConnectionEstablished = false;
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = clientSocket;
+            epoll_ctl(shard.EpollFd, EPOLL_CTL_ADD, clientSocket, &ev);
+        }
+
+        // Returns false if the connection was closed
+        bool ReadClient(ReactorShard& shard, ClientConnection& client) {
+            char* buffer = client.Parser.PrepareWrite(RECV_BUFFER_SIZE);
+            int bytesRead = static_cast<int>(recv(client.Socket, buffer, RECV_BUFFER_SIZE, 0));
+            if (bytesRead == 0)
+                return false;
+            if (bytesRead < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+            if (client.IsWebsocketConnectionEstablished) {
+                client.Parser.CommitWrite(bytesRead);
+                bool isOpen = HandleFrames(client.Socket, client.Parser, [&](std::string_view payload, unsigned char opcode) {
+                    EnqueueFrame(client, CreateFrame(payload, opcode), false);
+                });
+                // Replies (pong, close) are written right away, a close frame is sent before the connection is closed
+                return WriteClient(shard, client) && isOpen;
+            }
+
+            // The upgrade request may arrive in multiple reads, only the new bytes can complete the terminator
+            size_t searchStart = client.HandshakeBuffer.size() < 3 ? 0 : client.HandshakeBuffer.size() - 3;
+            client.HandshakeBuffer.append(buffer, bytesRead);
+            auto requestEnd = client.HandshakeBuffer.find("\r\n\r\n", searchStart);
+            if (requestEnd == std::string::npos) {
+                if (client.HandshakeBuffer.size() < MAX_HANDSHAKE_SIZE)
+                    return true;
+                DEBUG_PRINT("[WebSocketServer] Socket %llu: Upgrade request too large, closing connection\n", static_cast<ui64>(client.Socket));
+                return false;
+            }
+            requestEnd += 4;
+
+            DEBUG_PRINT("[WebSocketServer] Socket %llu: Negotiating connection...\n", static_cast<ui64>(client.Socket));
+            int deflateWindowBits = 0;
+            auto response = BuildHandshakeResponse(client.HandshakeBuffer.substr(0, requestEnd), deflateWindowBits);
+            // The terminator was completed by this read, so the bytes after the request are at the end of the read buffer
+            size_t leftoverSize = client.HandshakeBuffer.size() - requestEnd;
+            client.HandshakeBuffer.clear();
+            client.HandshakeBuffer.shrink_to_fit();
+            if (response.empty())
+                return false;
+
+            if (deflateWindowBits > 0) {
+                client.DeflateWindowBits = deflateWindowBits;
+                client.Parser.EnableCompression();
+                AddDeflateClient(deflateWindowBits);
+            }
+
+            EnqueueFrame(client, std::make_shared<const std::string>(std::move(response)), false);
+            client.IsWebsocketConnectionEstablished = true;
+            AddClientStats(client.Socket);
+            if (m_onClientConnectedHandler)
+                m_onClientConnectedHandler(client.Socket);
+
+            // Frames the client sent right behind the upgrade request
+            bool isOpen = true;
+            if (leftoverSize > 0) {
+                std::memmove(buffer, buffer + bytesRead - leftoverSize, leftoverSize);
+                client.Parser.CommitWrite(leftoverSize);
+                isOpen = HandleFrames(client.Socket, client.Parser, [&](std::string_view payload, unsigned char opcode) {
+                    EnqueueFrame(client, CreateFrame(payload, opcode), false);
+                });
+            }
+            return WriteClient(shard, client) && isOpen;
+        }
+
+        // Writes as much of the outbound queue as the socket accepts, returns false if the connection was closed
+        bool WriteClient(ReactorShard& shard, ClientConnection& client) {
+            bool isBlocked;
+            if (!WriteOutbound(client, isBlocked))
+                return false;
+
+            // Socket buffer is full, continue when the socket becomes writable
+            if (isBlocked != client.IsWaitingForWritable)
+                SetWaitForWritable(shard, client, isBlocked);
+            return true;
+        }
+
+        void SetWaitForWritable(ReactorShard& shard, ClientConnection& client, bool wait) {
+            epoll_event ev{};
+            ev.events = wait ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.fd = client.Socket;
+            epoll_ctl(shard.EpollFd, EPOLL_CTL_MOD, client.Socket, &ev);
+            client.IsWaitingForWritable = wait;
+        }
+
+        // Registers the sockets and moves the frames queued by other threads into the outbound queues of the clients and writes them
+        void DistributePendingFrames(ReactorShard& shard, std::vector<SOCKET>& closedSockets) {
+            {
+                std::lock_guard<std::mutex> lock(shard.PendingMutex);
+                shard.DistributingFrames.swap(shard.PendingFrames);
+                shard.AdoptingSockets.swap(shard.AcceptedSockets);
+            }
+
+            for (auto socket : shard.AdoptingSockets)
+                AddReactorClient(shard, socket);
+            shard.AdoptingSockets.clear();
+
+            for (auto& pending : shard.DistributingFrames) {
+                if (pending.Target != INVALID_SOCKET) {
+                    auto it = shard.Clients.find(pending.Target);
+                    if (it == shard.Clients.end())
+                        continue;
+                    if (pending.Frame)
+                        EnqueueFrame(it->second, std::move(pending.Frame), pending.IsDroppable);
+                    else
+                        it->second.Group = pending.Group;
+                    continue;
+                }
+
+                // Only the reference is copied, all clients share the encoded frame
+                for (auto& [socket, client] : shard.Clients) {
+                    if (!client.IsWebsocketConnectionEstablished || (pending.Group != ALL_GROUPS && client.Group != pending.Group))
+                        continue;
+                    if (!EnqueueBroadcastFrame(client, SelectFrame(client, pending.Frame, pending.CompressedFrame), pending.IsDroppable)) {
+                        // Closed after distribution, no further frames are queued for it
+                        client.IsWebsocketConnectionEstablished = false;
+                        closedSockets.push_back(socket);
+                    }
+                }
+            }
+            shard.DistributingFrames.clear();
+
+            for (auto& [socket, client] : shard.Clients) {
+                if (client.IsWebsocketConnectionEstablished && !client.IsWaitingForWritable && !client.Outbound.empty() && !WriteClient(shard, client))
+                    closedSockets.push_back(socket);
+            }
+        }
+
+        void CloseReactorClient(ReactorShard& shard, SOCKET clientSocket) {
+            DEBUG_PRINT("[WebSocketServer] Socket %llu: Cleaning up data\n", static_cast<ui64>(clientSocket));
+
+            epoll_ctl(shard.EpollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+            auto it = shard.Clients.find(clientSocket);
+            if (it == shard.Clients.end())
+                return; // Already closed
+            if (it->second.DeflateWindowBits > 0)
+                RemoveDeflateClient(it->second.DeflateWindowBits);
+            shard.Clients.erase(it);
+            RemoveClientStats(clientSocket);
+            if (m_onClientDisconnectedHandler)
+                m_onClientDisconnectedHandler(clientSocket);
+            DEBUG_PRINT("[WebSocketServer] Active clients: %llu\n", static_cast<ui64>(shard.Clients.size()));
+
+            shutdown(clientSocket, SD_BOTH);
+            closesocket(clientSocket);
+        }
+        #pragma endregion
+#endif
 
         #pragma region MessageNegotiation
-        inline void NegotiateConnection(const SOCKET clientSocket, const char* buffer, const int bufferLength) {
+        // Returns the window bits of the negotiated permessage-deflate, 0 if it was not negotiated
+        inline int NegotiateConnection(const SOCKET clientSocket, const char* buffer, const int bufferLength) {
             std::string request(buffer, bufferLength);
 
             DEBUG_PRINT("[WebSocketServer] Socket %llu: NegotiateConnection: Received data %s\n", static_cast<ui64>(clientSocket), buffer);
+            int deflateWindowBits = 0;
+            auto response = BuildHandshakeResponse(request, deflateWindowBits);
+            if (response.empty())
+                return 0;
+
+            send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+            if (deflateWindowBits > 0)
+                AddDeflateClient(deflateWindowBits);
+            return deflateWindowBits;
+        }
+
+        // Returns the "101 Switching Protocols" response to an upgrade request, or an empty string if it is none.
+        // deflateWindowBits is set to the window of the negotiated permessage-deflate, it stays 0 if none was negotiated
+        inline std::string BuildHandshakeResponse(const std::string& request, int& deflateWindowBits) {
             if (request.find("Upgrade: websocket") != std::string::npos) {
                 const std::string attributeSec = "Sec-WebSocket-Key: ";
                 auto startIdx = request.find(attributeSec) + attributeSec.size();
@@ -401,10 +1253,72 @@ namespace Ext {
                 response += "Connection: Upgrade\r\n";
                 response += "Upgrade: websocket\r\n";
                 response += "Sec-WebSocket-Accept: " + result + "\r\n";
+
+                auto extension = NegotiateDeflate(request, deflateWindowBits);
+                if (!extension.empty())
+                    response += "Sec-WebSocket-Extensions: " + extension + "\r\n";
+
                 response += "\r\n";
+                return response;
+            }
+            return {};
+        }
 
-                send(clientSocket, response.c_str(), static_cast<int>(response.size()), 0);
+        // Accepts the first permessage-deflate offer (RFC 7692) whose parameters the server can fulfil, returns the
+        // extension response or an empty string. Messages are compressed on their own, so one compressed frame can be
+        // shared by all clients, which is why no context takeover is used in either direction.
+        // An offer with a smaller server_max_window_bits than configured is accepted with the smaller window, windowBits
+        // receives the window used for the client
+        inline std::string NegotiateDeflate(const std::string& request, int& windowBits) {
+            if (!m_isCompressionEnabled)
+                return {};
+
+            const std::string attributeExtensions = "Sec-WebSocket-Extensions:";
+            auto startIdx = request.find(attributeExtensions);
+            if (startIdx == std::string::npos)
+                return {};
+            startIdx += attributeExtensions.size();
+            auto offers = request.substr(startIdx, request.find_first_of("\r\n", startIdx) - startIdx);
+
+            size_t offerStart = 0;
+            while (offerStart <= offers.size()) {
+                auto offerEnd = std::min(offers.find(',', offerStart), offers.size());
+                auto offer = offers.substr(offerStart, offerEnd - offerStart);
+                offerStart = offerEnd + 1;
+
+                bool isDeflate = false;
+                bool isAcceptable = true;
+                bool hasServerWindowBits = false;
+                int offerWindowBits = m_compressionWindowBits;
+                size_t paramStart = 0;
+                while (paramStart <= offer.size()) {
+                    auto paramEnd = std::min(offer.find(';', paramStart), offer.size());
+                    auto param = Trim(offer.substr(paramStart, paramEnd - paramStart));
+                    paramStart = paramEnd + 1;
+
+                    if (param == "permessage-deflate")
+                        isDeflate = true;
+                    else if (param.rfind("server_max_window_bits=", 0) == 0) {
+                        // The server must not use a larger window than the client offers
+                        hasServerWindowBits = true;
+                        int maxWindowBits = std::atoi(param.c_str() + sizeof("server_max_window_bits=") - 1);
+                        isAcceptable &= maxWindowBits >= Deflater::MIN_WINDOW_BITS;
+                        offerWindowBits = std::min(offerWindowBits, maxWindowBits);
+                    }
+                    else if (param != "server_no_context_takeover" && param != "client_no_context_takeover" && param.rfind("client_max_window_bits", 0) != 0)
+                        isAcceptable = false;
+                }
+
+                if (!isDeflate || !isAcceptable)
+                    continue;
+
+                std::string extension = "permessage-deflate; server_no_context_takeover; client_no_context_takeover";
+                if (hasServerWindowBits)
+                    extension += "; server_max_window_bits=" + std::to_string(offerWindowBits);
+                windowBits = offerWindowBits;
+                return extension;
             }
+            return {};
         }
 
         inline std::string Trim(const std::string& str) {
@@ -481,11 +1395,36 @@ namespace Ext {
 
         int m_port;
         std::atomic<bool> m_isRunning;
+        bool m_tcpNoDelay = false;
+        bool m_tcpCork = false;
+        size_t m_maxOutboundBytes = 0;
+        SlowClientPolicy m_slowClientPolicy = SlowClientPolicy::DropOldest;
+        bool m_isCompressionEnabled = false;
+        int m_compressionLevel = 6;
+        int m_compressionWindowBits = Deflater::MAX_WINDOW_BITS;
+        std::atomic<int> m_deflateClientCount = 0;
+        std::atomic<int> m_deflateWindowClientCounts[Deflater::MAX_WINDOW_BITS + 1] = {};  //Clients with permessage-deflate per window bits
+        std::mutex m_deflaterMutex;
+        Deflater m_deflater;
+        int m_deflaterWindowBits = Deflater::MAX_WINDOW_BITS;     //Window m_deflater is configured with
+        std::string m_compressedMessage;    //Reused output of m_deflater
         std::thread m_serverThread;
-        std::vector<ClientConnection> m_activeClients;
+#ifndef QD_WEBSOCKET_EPOLL
+        CopyOnWriteList<ClientConnection> m_clients;   //Clients with an established WebSocket connection
+#endif
+
+        std::mutex m_clientStatsMutex;
+        std::unordered_map<SOCKET, ClientStats> m_clientStats;
+
+#ifdef QD_WEBSOCKET_EPOLL
+        size_t m_ioThreadCount = 1;
+        std::vector<std::unique_ptr<ReactorShard>> m_shards;   //Created by Start(), fixed while the server runs
+        std::vector<std::thread> m_reactorThreads;
+#endif
 
-        std::function<void(SOCKET, const std::string&)> m_messageHandler;
+        std::function<void(SOCKET, std::string_view)> m_messageHandler;
         std::function<void(SOCKET)> m_onClientConnectedHandler;
+        std::function<void(SOCKET)> m_onClientDisconnectedHandler;
     };
 }
 
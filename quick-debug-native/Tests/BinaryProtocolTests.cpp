@@ -0,0 +1,95 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/BinaryProtocol.hpp"
+
+using QD::BinaryProtocol;
+
+// Reads the little endian wire format back, the way the client does
+struct Reader {
+    const std::string& Data;
+    size_t Position = 0;
+
+    template <typename T>
+    T Read() {
+        T value{};
+        std::memcpy(&value, Data.data() + Position, sizeof(T));
+        Position += sizeof(T);
+        return value;
+    }
+
+    int64_t ReadZigZagVarint() {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            auto byte = static_cast<unsigned char>(Data[Position++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    bool IsAtEnd() const {
+        return Position == Data.size();
+    }
+};
+
+TEST(EncodesSeriesTableRange) {
+    std::vector<std::string> names = { "zero", "one", "two", std::string(300, 'n') };
+    auto message = BinaryProtocol::EncodeSeriesTable(names, 1, 4);
+
+    Reader reader{ message };
+    CHECK(reader.Read<ui8>() == BinaryProtocol::SERIES_TABLE_MESSAGE);
+    CHECK(reader.Read<ui16>() == 3);
+    for (ui16 id = 1; id < 4; ++id) {
+        CHECK(reader.Read<ui16>() == id);
+        auto length = reader.Read<ui8>();
+        CHECK(length == std::min(names[id].size(), BinaryProtocol::MAX_SERIES_NAME_LENGTH));
+        CHECK(message.compare(reader.Position, length, names[id], 0, length) == 0);
+        reader.Position += length;
+    }
+    CHECK(reader.IsAtEnd());
+}
+
+TEST(EncodesSamplesWithSignedTimestampDeltas) {
+    std::vector<BinaryProtocol::Sample> samples = {
+        { 7, 1000000, 1.5f },
+        { 8, 1000010, -2.0f },
+        { 7, 999990, 3.25f },      //Earlier sample of another thread
+        { 9, 5000000000ull, 0.0f },
+    };
+    auto message = BinaryProtocol::EncodeSamples(samples);
+
+    Reader reader{ message };
+    CHECK(reader.Read<ui8>() == BinaryProtocol::SAMPLES_MESSAGE);
+    CHECK(reader.Read<ui16>() == samples.size());
+    auto timestamp = static_cast<int64_t>(reader.Read<f64>());
+    CHECK(timestamp == 1000000);
+    for (auto& sample : samples) {
+        CHECK(reader.Read<ui16>() == sample.SeriesId);
+        timestamp += reader.ReadZigZagVarint();
+        CHECK(timestamp == static_cast<int64_t>(sample.TimestampUs));
+        CHECK(reader.Read<f32>() == sample.Value);
+    }
+    CHECK(reader.IsAtEnd());
+}
+
+TEST(SmallDeltasTakeOneByte) {
+    std::vector<BinaryProtocol::Sample> samples = { { 1, 100, 0 }, { 1, 163, 0 }, { 1, 100, 0 } };
+    auto message = BinaryProtocol::EncodeSamples(samples);
+    CHECK(message.size() == 3 + sizeof(f64) + samples.size() * (sizeof(ui16) + 1 + sizeof(f32)));
+}
+
+TEST(ReusesOutputBuffer) {
+    std::string out;
+    BinaryProtocol::EncodeSamples({ { 1, 10, 1 }, { 2, 20, 2 } }, out);
+    auto first = out;
+    BinaryProtocol::EncodeSamples({ { 3, 30, 3 } }, out);
+    CHECK(out == BinaryProtocol::EncodeSample(3, 30, 3));
+    CHECK(out != first);
+}
+
+int main() {
+    return Tests::RunTests();
+}
@@ -0,0 +1,137 @@
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/Common/ConcurrentQueue.hpp"
+
+#include <thread>
+
+namespace {
+    std::vector<int> Drain(ConcurrentQueue<int>& queue) {
+        std::vector<int> items;
+        int item;
+        while (queue.TryPop(item))
+            items.push_back(item);
+        return items;
+    }
+
+    bool IsDroppable(const int& item) {
+        return item >= 0;
+    }
+}
+
+TEST(UnboundedQueueGrows) {
+    ConcurrentQueue<int> queue;
+    for (int i = 0; i < 100; ++i)
+        CHECK(queue.PushBounded(int(i)));
+
+    auto items = Drain(queue);
+    CHECK(items.size() == 100);
+    CHECK(items.front() == 0 && items.back() == 99);
+    CHECK(queue.DroppedCount() == 0);
+}
+
+TEST(BlockWaitsForConsumer) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(2, QueueFullPolicy::Block);
+    CHECK(queue.PushBounded(1));
+    CHECK(queue.PushBounded(2));
+
+    std::atomic<bool> isPushed = false;
+    std::thread producer([&] {
+        queue.PushBounded(3);
+        isPushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!isPushed);
+    CHECK(queue.Size() == 2);
+
+    CHECK(queue.Pop() == 1);
+    producer.join();
+    CHECK(isPushed);
+    CHECK((Drain(queue) == std::vector<int>{ 2, 3 }));
+    CHECK(queue.DroppedCount() == 0);
+}
+
+TEST(DropNewestDiscardsNewItem) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(2, QueueFullPolicy::DropNewest);
+    CHECK(queue.PushBounded(1));
+    CHECK(queue.PushBounded(2));
+    CHECK(!queue.PushBounded(3));
+    CHECK(!queue.PushBounded(4));
+
+    CHECK((Drain(queue) == std::vector<int>{ 1, 2 }));
+    CHECK(queue.DroppedCount() == 2);
+}
+
+TEST(DropOldestDiscardsOldestItem) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(3, QueueFullPolicy::DropOldest);
+    for (int i = 1; i <= 3; ++i)
+        CHECK(queue.PushBounded(int(i)));
+    CHECK(!queue.PushBounded(4));
+
+    // The ring buffer wraps around before the next eviction
+    CHECK(queue.Pop() == 2);
+    CHECK(queue.PushBounded(5));
+    CHECK(!queue.PushBounded(6));
+
+    CHECK((Drain(queue) == std::vector<int>{ 4, 5, 6 }));
+    CHECK(queue.DroppedCount() == 2);
+}
+
+TEST(DropOldestNeverEvictsNonDroppableItems) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(3, QueueFullPolicy::DropOldest);
+    queue.Push(-1);
+    CHECK(queue.PushBounded(1, IsDroppable));
+    queue.Push(-2);
+
+    // The oldest droppable item is evicted, the others keep their order
+    CHECK(!queue.PushBounded(2, IsDroppable));
+    CHECK((Drain(queue) == std::vector<int>{ -1, -2, 2 }));
+
+    // Without a droppable item the new one is queued beyond the capacity
+    queue.Push(-1);
+    queue.Push(-2);
+    queue.Push(-3);
+    CHECK(queue.PushBounded(3, IsDroppable));
+    CHECK((Drain(queue) == std::vector<int>{ -1, -2, -3, 3 }));
+    CHECK(queue.DroppedCount() == 1);
+}
+
+TEST(PushIgnoresCapacity) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(2, QueueFullPolicy::DropNewest);
+    for (int i = 0; i < 5; ++i)
+        queue.Push(int(i));
+
+    CHECK(queue.Size() == 5);
+    CHECK(queue.DroppedCount() == 0);
+}
+
+TEST(ShutdownReleasesBlockedProducers) {
+    ConcurrentQueue<int> queue;
+    queue.SetCapacity(1, QueueFullPolicy::Block);
+    CHECK(queue.PushBounded(0));
+
+    std::atomic<int> pushed = 0;
+    std::vector<std::thread> producers;
+    for (int i = 1; i <= 3; ++i) {
+        producers.emplace_back([&queue, &pushed, i] {
+            queue.PushBounded(int(i));
+            pushed++;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(pushed == 0);
+
+    // QuickDebug::Shutdown() makes the queue unbounded so no producer stays blocked
+    queue.SetCapacity(0, QueueFullPolicy::Block);
+    for (auto& producer : producers)
+        producer.join();
+    CHECK(pushed == 3);
+    CHECK(queue.Size() == 4);
+}
+
+int main() {
+    return Tests::RunTests();
+}
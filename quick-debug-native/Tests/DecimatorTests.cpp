@@ -0,0 +1,126 @@
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/Decimator.hpp"
+
+using QD::DecimationMode;
+using QD::SeriesDecimator;
+
+namespace {
+    struct Point {
+        ui64 TimestampUs;
+        f32 Value;
+
+        bool operator==(const Point&) const = default;
+    };
+
+    // Feeds the samples to a decimator and returns the emitted points, including the ones of the final Flush()
+    std::vector<Point> Decimate(std::vector<Point> samples, DecimationMode mode, ui32 pointsPerSecond) {
+        std::vector<Point> points;
+        auto emit = [&](ui64 timestampUs, f32 value) { points.push_back({ timestampUs, value }); };
+
+        SeriesDecimator decimator;
+        ui64 bucketLengthUs = SeriesDecimator::GetBucketLengthUs(pointsPerSecond, mode);
+        for (auto& sample : samples)
+            decimator.Add(sample.TimestampUs, sample.Value, mode, bucketLengthUs, emit);
+        decimator.Flush(mode, emit);
+        return points;
+    }
+}
+
+TEST(BucketLength) {
+    CHECK(SeriesDecimator::GetBucketLengthUs(1000, DecimationMode::Last) == 1000);
+    CHECK(SeriesDecimator::GetBucketLengthUs(1000, DecimationMode::Lttb) == 1000);
+    CHECK(SeriesDecimator::GetBucketLengthUs(1000, DecimationMode::MinMax) == 2000);
+    CHECK(SeriesDecimator::GetBucketLengthUs(0, DecimationMode::Last) == 1000000);
+    CHECK(SeriesDecimator::GetBucketLengthUs(5000000, DecimationMode::Last) == 1);
+}
+
+TEST(BucketsAreAligned) {
+    std::vector<Point> points;
+    auto emit = [&](ui64 timestampUs, f32 value) { points.push_back({ timestampUs, value }); };
+
+    SeriesDecimator decimator;
+    CHECK(!decimator.HasOpenBucket());
+    CHECK(decimator.GetBucketEndUs(1000) == 0);
+
+    decimator.Add(1234567, 1, DecimationMode::Last, 1000, emit);
+    CHECK(decimator.HasOpenBucket());
+    CHECK(decimator.GetBucketEndUs(1000) == 1235000);
+
+    decimator.Add(1234999, 2, DecimationMode::Last, 1000, emit);
+    CHECK(points.empty());
+
+    decimator.Add(1235000, 3, DecimationMode::Last, 1000, emit);
+    CHECK((points == std::vector<Point>{ { 1234999, 2 } }));
+    CHECK(decimator.GetBucketEndUs(1000) == 1236000);
+}
+
+TEST(LastKeepsLastSampleOfBucket) {
+    auto points = Decimate({ { 100, 1 }, { 900, 2 }, { 1200, 3 }, { 2500, 4 } }, DecimationMode::Last, 1000);
+    CHECK((points == std::vector<Point>{ { 900, 2 }, { 1200, 3 }, { 2500, 4 } }));
+}
+
+TEST(MeanAveragesValueAndTimestamp) {
+    auto points = Decimate({ { 100, 1 }, { 300, 3 }, { 1100, 10 }, { 1500, 20 } }, DecimationMode::Mean, 1000);
+    CHECK((points == std::vector<Point>{ { 200, 2 }, { 1300, 15 } }));
+}
+
+TEST(MinMaxKeepsExtremesInOrder) {
+    auto points = Decimate({
+        { 0, 5 }, { 500, 1 }, { 1000, 9 }, { 1900, 4 },     // Minimum before maximum
+        { 2100, 8 }, { 2500, 2 },                           // Maximum before minimum
+        { 4200, 3 } },                                      // Single sample, emitted once
+        DecimationMode::MinMax, 1000);
+    CHECK((points == std::vector<Point>{ { 500, 1 }, { 1000, 9 }, { 2100, 8 }, { 2500, 2 }, { 4200, 3 } }));
+}
+
+TEST(LttbSelectsLargestTriangle) {
+    // The first point is always kept. (300, 5) spans the largest triangle between it and the average of the
+    // second bucket, (1000, 0) the largest between (300, 5) and the third bucket, whose last point ends the series.
+    auto points = Decimate({
+        { 0, 0 }, { 300, 5 }, { 600, 1 },
+        { 1000, 0 }, { 1500, 0 },
+        { 2000, 0 } },
+        DecimationMode::Lttb, 1000);
+    CHECK((points == std::vector<Point>{ { 0, 0 }, { 300, 5 }, { 1000, 0 }, { 2000, 0 } }));
+}
+
+TEST(LttbDelaysPointsByOneBucket) {
+    std::vector<Point> points;
+    auto emit = [&](ui64 timestampUs, f32 value) { points.push_back({ timestampUs, value }); };
+
+    SeriesDecimator decimator;
+    decimator.Add(0, 1, DecimationMode::Lttb, 1000, emit);
+    decimator.Add(1000, 2, DecimationMode::Lttb, 1000, emit);
+    CHECK(points.empty());
+
+    decimator.Add(2000, 3, DecimationMode::Lttb, 1000, emit);
+    CHECK((points == std::vector<Point>{ { 0, 1 } }));
+}
+
+TEST(FlushEmitsIdleBucket) {
+    std::vector<Point> points;
+    auto emit = [&](ui64 timestampUs, f32 value) { points.push_back({ timestampUs, value }); };
+
+    SeriesDecimator decimator;
+    decimator.Add(100, 1, DecimationMode::Mean, 1000, emit);
+    decimator.Add(300, 2, DecimationMode::Mean, 1000, emit);
+    decimator.Flush(DecimationMode::Mean, emit);
+    CHECK((points == std::vector<Point>{ { 200, 1.5f } }));
+    CHECK(!decimator.HasOpenBucket());
+
+    // LTTB also emits the bucket that waits for a following one
+    points.clear();
+    decimator.Add(5000, 4, DecimationMode::Lttb, 1000, emit);
+    decimator.Add(6000, 5, DecimationMode::Lttb, 1000, emit);
+    CHECK(decimator.HasOpenBucket());
+    decimator.Flush(DecimationMode::Lttb, emit);
+    CHECK((points == std::vector<Point>{ { 5000, 4 }, { 6000, 5 } }));
+    CHECK(!decimator.HasOpenBucket());
+
+    decimator.Flush(DecimationMode::Lttb, emit);
+    CHECK(points.size() == 2);
+}
+
+int main() {
+    return Tests::RunTests();
+}
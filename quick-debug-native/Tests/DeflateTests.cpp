@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/Deflate.hpp"
+
+using Ext::Deflater;
+using Ext::Inflater;
+
+// Text protocol batch, like the publisher sends it
+static std::string SampleBatch(size_t size) {
+    std::mt19937 random(1);
+    std::string batch;
+    char line[64];
+    for (int i = 0; batch.size() < size; ++i) {
+        std::snprintf(line, sizeof(line), "1;%s;%.3f;%d\n", i % 2 ? "sin" : "cos", static_cast<float>(random() % 2000) / 1000.0f, 400000 + i * 37);
+        batch += line;
+    }
+    return batch;
+}
+
+static std::string RandomBytes(size_t size) {
+    std::mt19937 random(2);
+    std::string bytes(size, '\0');
+    for (auto& byte : bytes)
+        byte = static_cast<char>(random());
+    return bytes;
+}
+
+static bool RoundTrips(Deflater& deflater, Inflater& inflater, const std::string& message) {
+    std::string compressed;
+    std::string inflated;
+    deflater.Compress(message, compressed);
+    return inflater.Inflate(compressed, inflated, message.size()) && inflated == message;
+}
+
+TEST(RoundTripsAllLevelsAndWindows) {
+    Inflater inflater;
+    for (int level = Deflater::MIN_LEVEL; level <= Deflater::MAX_LEVEL; ++level) {
+        for (int windowBits : { Deflater::MIN_WINDOW_BITS, 12, Deflater::MAX_WINDOW_BITS }) {
+            Deflater deflater(level, windowBits);
+            CHECK(RoundTrips(deflater, inflater, SampleBatch(20000)));
+            CHECK(RoundTrips(deflater, inflater, RandomBytes(5000)));
+            CHECK(RoundTrips(deflater, inflater, std::string(100000, 'a')));
+        }
+    }
+}
+
+TEST(RoundTripsEdgeCases) {
+    Deflater deflater;
+    Inflater inflater;
+    CHECK(RoundTrips(deflater, inflater, ""));
+    CHECK(RoundTrips(deflater, inflater, "a"));
+    CHECK(RoundTrips(deflater, inflater, "abcabcabc"));
+    CHECK(RoundTrips(deflater, inflater, std::string(258 * 3 + 1, 'x')));    //Longest matches
+}
+
+TEST(MessagesDoNotDependOnEachOther) {
+    Deflater deflater;
+    Inflater inflater;
+    auto message = SampleBatch(4000);
+    std::string first;
+    std::string second;
+    deflater.Compress(message, first);
+    deflater.Compress(message, second);
+    CHECK(first == second);     //No context takeover, every frame can be inflated on its own
+
+    std::string inflated;
+    CHECK(inflater.Inflate(second, inflated, message.size()) && inflated == message);
+}
+
+TEST(CompressesSampleBatches) {
+    auto batch = SampleBatch(75000);
+    std::string fast;
+    std::string best;
+    Deflater(1).Compress(batch, fast);
+    Deflater(9).Compress(batch, best);
+
+    // The values are random, so mostly the names, separators and timestamps compress
+    CHECK(fast.size() < batch.size() / 2);
+    CHECK(best.size() < fast.size());
+}
+
+// Shortest of several runs, in microseconds
+static double CompressTimeUs(Deflater& deflater, const std::string& message) {
+    std::string compressed;
+    double shortest = 1e12;
+    for (int i = 0; i < 5; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        deflater.Compress(message, compressed);
+        shortest = std::min(shortest, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    return shortest;
+}
+
+TEST(HighestLevelStaysFast) {
+    auto batch = SampleBatch(75000);
+    Deflater fast(1);
+    Deflater best(9);
+
+    // About 5x, hash chains that looped back to their own position made level 9 about 40x slower than level 1
+    CHECK(CompressTimeUs(best, batch) < 20 * CompressTimeUs(fast, batch));
+}
+
+TEST(RejectsInvalidAndOversizedInput) {
+    Deflater deflater;
+    Inflater inflater;
+    std::string compressed;
+    std::string inflated;
+    deflater.Compress(std::string(1000, 'a'), compressed);
+    CHECK(!inflater.Inflate(compressed, inflated, 999));
+    CHECK(!inflater.Inflate(std::string("\xFF\xFF\xFF", 3), inflated, 1000));
+}
+
+int main() {
+    return Tests::RunTests();
+}
@@ -0,0 +1,92 @@
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/Statistics.hpp"
+
+using QD::LatencyHistogram;
+
+// Percentiles are at most one bucket off, buckets hold 1/32 of a power of two
+static bool IsClose(uint32_t value, uint32_t expected) {
+    return value >= expected && value <= expected + expected / 32 + 1;
+}
+
+TEST(EmptyHistogram) {
+    LatencyHistogram histogram;
+    CHECK(histogram.GetCount() == 0);
+    CHECK(histogram.GetMax() == 0);
+    CHECK(histogram.GetPercentile(99) == 0);
+}
+
+TEST(SmallValuesAreExact) {
+    LatencyHistogram histogram;
+    for (uint32_t value = 1; value <= 50; ++value)
+        histogram.Record(value);
+
+    CHECK(histogram.GetCount() == 50);
+    CHECK(histogram.GetMax() == 50);
+    CHECK(histogram.GetPercentile(50) == 25);
+    CHECK(histogram.GetPercentile(100) == 50);
+    CHECK(histogram.GetPercentile(0) == 1);
+}
+
+TEST(LargeValuesWithinBucketPrecision) {
+    LatencyHistogram histogram;
+    for (uint32_t value = 1; value <= 100000; ++value)
+        histogram.Record(value);
+
+    CHECK(IsClose(histogram.GetPercentile(50), 50000));
+    CHECK(IsClose(histogram.GetPercentile(99), 99000));
+    CHECK(histogram.GetPercentile(100) == 100000);
+    CHECK(histogram.GetMax() == 100000);
+}
+
+TEST(PercentileNeverExceedsMax) {
+    LatencyHistogram histogram;
+    histogram.Record(UINT32_MAX);
+    histogram.Record(1000001);
+    CHECK(IsClose(histogram.GetPercentile(50), 1000001));
+    CHECK(histogram.GetPercentile(100) == UINT32_MAX);
+}
+
+TEST(AddAndMoveCombineHistograms) {
+    LatencyHistogram a;
+    LatencyHistogram b;
+    for (uint32_t value = 0; value < 100; ++value)
+        a.Record(value);
+    b.Record(5000);
+
+    LatencyHistogram total;
+    total.Add(a);
+    total.Add(b);
+    CHECK(total.GetCount() == 101);
+    CHECK(total.GetMax() == 5000);
+    CHECK(a.GetCount() == 100);
+
+    LatencyHistogram window;
+    a.MoveTo(window);
+    CHECK(a.GetCount() == 0);
+    CHECK(a.GetMax() == 0);
+    CHECK(window.GetCount() == 100);
+    CHECK(window.GetPercentile(100) == 99);
+}
+
+TEST(ConcurrentRecording) {
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram, t]() {
+            for (uint32_t i = 0; i < 100000; ++i)
+                histogram.Record(t * 1000 + i % 1000);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK(histogram.GetCount() == 400000);
+    CHECK(histogram.GetMax() == 3999);
+}
+
+int main() {
+    return Tests::RunTests();
+}
@@ -0,0 +1,121 @@
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/LatencyMonitor.hpp"
+
+#include <thread>
+
+using QD::LatencyMonitor;
+using QD::LatencyStage;
+
+namespace {
+    // Spaces the timestamps of a test apart, so an elapsed time of 0 only means the frame was not found
+    void WaitForClock() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+TEST(NewerFrameTakesOverSlot) {
+    // Frames 1 and 5 map to the same slot
+    LatencyMonitor::SetMaxBufferSize(4);
+    auto begin = LatencyMonitor::RegisterStage("reuse begin");
+    auto end = LatencyMonitor::RegisterStage("reuse end");
+
+    LatencyMonitor::TakeTimestampMeasurement(1, begin);
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(1, end);
+    CHECK(LatencyMonitor::MeasureElapsedTime(1, begin, end).count() > 0);
+
+    // The timestamps of frame 1 are ignored from now on, the one it left at the end stage as well
+    LatencyMonitor::TakeTimestampMeasurement(5, begin);
+    CHECK(LatencyMonitor::MeasureElapsedTime(1, begin, end).count() == 0);
+    CHECK(LatencyMonitor::MeasureElapsedTime(5, begin, end).count() == 0);
+
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(5, end);
+    CHECK(LatencyMonitor::MeasureElapsedTime(5, begin, end).count() > 0);
+}
+
+TEST(OlderFrameIsRejected) {
+    LatencyMonitor::SetMaxBufferSize(4);
+    auto begin = LatencyMonitor::RegisterStage("reject begin");
+    auto end = LatencyMonitor::RegisterStage("reject end");
+
+    LatencyMonitor::TakeTimestampMeasurement(10, begin);
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(10, end);
+    auto elapsed = LatencyMonitor::MeasureElapsedTime(10, begin, end);
+    CHECK(elapsed.count() > 0);
+
+    // Frame 6 maps to the slot of frame 10, which keeps its timestamps
+    LatencyMonitor::TakeTimestampMeasurement(6, begin);
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(6, end);
+    CHECK(LatencyMonitor::MeasureElapsedTime(6, begin, end).count() == 0);
+    CHECK(LatencyMonitor::MeasureElapsedTime(10, begin, end) == elapsed);
+}
+
+TEST(TimeDeltaToPreviousFrame) {
+    LatencyMonitor::SetMaxBufferSize(100);
+    auto stage = LatencyMonitor::RegisterStage("delta");
+
+    // The first measurement of a stage has no previous frame
+    LatencyMonitor::TakeTimestampMeasurement(20, stage);
+    CHECK(LatencyMonitor::MeasureTimeDelta(20, stage).count() == 0);
+
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(21, stage);
+    CHECK(LatencyMonitor::MeasureTimeDelta(21, stage) >= std::chrono::milliseconds(2));
+}
+
+TEST(TimeDeltaOfFrameTakenOutOfOrder) {
+    LatencyMonitor::SetMaxBufferSize(100);
+    auto stage = LatencyMonitor::RegisterStage("delta out of order");
+
+    LatencyMonitor::TakeTimestampMeasurement(30, stage);
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(32, stage);
+    WaitForClock();
+    LatencyMonitor::TakeTimestampMeasurement(31, stage);
+
+    // Frame 31 passed after the newer frame 32, so its previous frame is unknown
+    CHECK(LatencyMonitor::MeasureTimeDelta(31, stage).count() == 0);
+    CHECK(LatencyMonitor::MeasureTimeDelta(32, stage) >= std::chrono::milliseconds(2));
+    CHECK(LatencyMonitor::MeasureTimeDelta(32, "delta out of order") == LatencyMonitor::MeasureTimeDelta(32, stage));
+}
+
+TEST(ReadOfChangedStageIsDiscarded) {
+    LatencyStage stage;
+    std::chrono::steady_clock::rep time = 0;
+    i64 prevFrame = 0;
+    CHECK(!stage.Read(1, time, prevFrame));
+
+    stage.Write(1, 0, 10);
+    CHECK(stage.Read(1, time, prevFrame));
+    CHECK(time == 10 && prevFrame == 0);
+    CHECK(!stage.Read(2, time, prevFrame));
+
+    // A writer overwrites the stage while it is read, every read that succeeds has to see a single write
+    std::atomic<bool> isWriting = true;
+    std::thread writer([&] {
+        for (i64 frame = 2; frame < 200000; ++frame)
+            stage.Write(frame, frame - 1, frame * 10);
+        isWriting = false;
+    });
+
+    size_t reads = 0, tornReads = 0;
+    while (isWriting) {
+        i64 frame = stage.frame.load(std::memory_order_relaxed);
+        if (frame < 0 || !stage.Read(frame, time, prevFrame))
+            continue;
+
+        reads++;
+        if (time != frame * 10 || prevFrame != frame - 1)
+            tornReads++;
+    }
+    writer.join();
+    CHECK(reads > 0);
+    CHECK(tornReads == 0);
+}
+
+int main() {
+    return Tests::RunTests();
+}
@@ -0,0 +1,153 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/QuickDebug.hpp"
+
+// Counts the allocations of the threads that set t_isCounting, Plot() must not allocate once a series is known
+static thread_local bool t_isCounting = false;
+static std::atomic<size_t> g_allocations = 0;
+
+void* operator new(size_t size) {
+    if (t_isCounting)
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// GCC warns about free() on memory from operator new where it inlines the replacements into each other
+#ifdef __GNUC__
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+NOINLINE void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+NOINLINE void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static const int PLOT_CALLS = 100000;
+static const unsigned short PORT = 8095;
+
+// Connects a WebSocket client that reads and discards everything, Plot() discards samples while no client is connected
+static bool ConnectClient() {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+    // The server starts listening on its own thread, so the first attempts may be refused
+    SOCKET clientSocket = INVALID_SOCKET;
+    for (int i = 0; i < 100 && clientSocket == INVALID_SOCKET; ++i) {
+        clientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (clientSocket != INVALID_SOCKET && connect(clientSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            closesocket(clientSocket);
+            clientSocket = INVALID_SOCKET;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    if (clientSocket == INVALID_SOCKET)
+        return false;
+
+    const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    send(clientSocket, request, sizeof(request) - 1, 0);
+
+    std::thread([clientSocket]() {
+        char buffer[64 * 1024];
+        while (recv(clientSocket, buffer, sizeof(buffer), 0) > 0) {
+        }
+    }).detach();
+
+    auto series = QD::QuickDebug::RegisterSeries("connected");
+    for (int i = 0; i < 200 && !QD::QuickDebug::IsSubscribed(series); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return QD::QuickDebug::IsSubscribed(series);
+}
+
+// Allocations of plotCalls() after warming up, i.e. after the queues and the publisher reached their steady state
+template <typename PlotCalls>
+static size_t CountSteadyStateAllocations(PlotCalls&& plotCalls) {
+    plotCalls();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    g_allocations.store(0);
+    t_isCounting = true;
+    plotCalls();
+    t_isCounting = false;
+    return g_allocations.load();
+}
+
+static void PlotSlowly(int count, void (*plot)(int)) {
+    for (int i = 0; i < count; ++i) {
+        plot(i);
+        if (i % 256 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));    //Keeps the queue below its capacity
+    }
+}
+
+TEST(PlotBySeriesHandleDoesNotAllocate) {
+    static auto series = QD::QuickDebug::RegisterSeries("handle");
+    CHECK(CountSteadyStateAllocations([]() {
+        PlotSlowly(PLOT_CALLS, [](int i) { QD::QuickDebug::Plot(series, static_cast<f32>(i)); });
+    }) == 0);
+}
+
+TEST(PlotByLiteralNameDoesNotAllocate) {
+    CHECK(CountSteadyStateAllocations([]() {
+        PlotSlowly(PLOT_CALLS, [](int i) { QD::QuickDebug::Plot<"literal">(static_cast<f32>(i)); });
+    }) == 0);
+}
+
+TEST(PlotByShortNameDoesNotAllocate) {
+    CHECK(CountSteadyStateAllocations([]() {
+        PlotSlowly(PLOT_CALLS, [](int i) { QD::QuickDebug::Plot("name", static_cast<f32>(i)); });
+    }) == 0);
+}
+
+TEST(PlotBlockDoesNotAllocate) {
+    static auto series = QD::QuickDebug::RegisterSeries("block");
+    CHECK(CountSteadyStateAllocations([]() {
+        for (int i = 0; i < PLOT_CALLS / 64; ++i) {
+            float values[64];
+            for (int k = 0; k < 64; ++k)
+                values[k] = static_cast<f32>(i + k);
+            QD::QuickDebug::Plot(series, values, 50.0f);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));   //Fewer blocks in flight than the payload pool holds
+        }
+    }) == 0);
+}
+
+// Run with --per-thread-queues to cover the per-thread ring buffers instead of the shared queue
+TEST(PlotFromAnotherThreadDoesNotAllocate) {
+    std::thread producer([]() {
+        CHECK(CountSteadyStateAllocations([]() {
+            PlotSlowly(PLOT_CALLS, [](int i) { QD::QuickDebug::Plot<"thread">(static_cast<f32>(i)); });
+        }) == 0);
+    });
+    producer.join();
+}
+
+int main(int argc, char** argv) {
+    QD::QuickDebugConfig cfg;
+    cfg.UseWebserver = false;
+    cfg.WebsocketPort = PORT;
+    cfg.UsePerThreadQueues = argc > 1 && std::string_view(argv[1]) == "--per-thread-queues";
+    cfg.PlotQueueCapacity = 1 << 16;
+    QD::QuickDebug::Startup(cfg);
+    if (!ConnectClient()) {
+        std::printf("Failed to connect to port %d\n", PORT);
+        return 1;
+    }
+
+    int result = Tests::RunTests();
+    std::fflush(stdout);
+    std::_Exit(result);     //The server threads are still running
+}
@@ -0,0 +1,69 @@
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/SeriesFilter.hpp"
+
+using QD::SeriesFilter;
+
+TEST(DefaultContainsEverySeries) {
+    SeriesFilter filter;
+    CHECK(filter.IsAll());
+    CHECK(filter.IncludesNewSeries());
+    CHECK(filter.Contains(0));
+    CHECK(filter.Contains(0xFFFE));
+    CHECK(filter.GetWord(1000) == ~0ull);
+}
+
+TEST(AddsAndRemovesSeries) {
+    SeriesFilter filter;
+    filter.Reset(false);
+    CHECK(!filter.IsAll());
+    CHECK(!filter.Contains(5));
+
+    filter.Add(5);
+    filter.Add(200);
+    CHECK(filter.Contains(5));
+    CHECK(filter.Contains(200));
+    CHECK(!filter.Contains(6));
+    CHECK(!filter.Contains(201));
+    CHECK(filter.GetWord(0) == (1ull << 5));
+    CHECK(filter.GetWord(3) == (1ull << (200 - 3 * 64)));
+
+    filter.Remove(5);
+    CHECK(!filter.Contains(5));
+    CHECK(filter.Contains(200));
+}
+
+TEST(UnsubscribedSeriesOfAllFilter) {
+    SeriesFilter filter;
+    filter.Remove(70);
+    CHECK(!filter.IsAll());
+    CHECK(!filter.Contains(70));
+    CHECK(filter.Contains(69));
+    CHECK(filter.Contains(5000));    //Registered later
+
+    filter.Add(70);
+    CHECK(filter.IsAll());
+}
+
+TEST(EqualFiltersCompareEqual) {
+    SeriesFilter a;
+    SeriesFilter b;
+    a.Reset(false);
+    b.Reset(false);
+    a.Add(1000);
+    a.Remove(1000);
+    CHECK(a == b);
+
+    b.Add(3);
+    CHECK(!(a == b));
+    a.Add(3);
+    CHECK(a == b);
+
+    SeriesFilter all;
+    CHECK(!(all == a));
+    a.Reset(true);
+    CHECK(all == a);
+}
+
+int main() {
+    return Tests::RunTests();
+}
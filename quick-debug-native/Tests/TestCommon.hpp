@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Minimal test harness, every test file is a standalone program built from the quick-debug-native directory:
+//   cl /std:c++20 /EHsc /O2 Tests\SeriesFilterTests.cpp
+//   g++ -std=c++20 -O2 -pthread Tests/SeriesFilterTests.cpp
+// TEST(name) defines a test, CHECK(condition) reports a failed condition and continues with the test.
+// main() returns RunTests(), which is non-zero if any check failed.
+
+namespace Tests {
+    struct TestCase {
+        const char* Name;
+        void (*Run)();
+    };
+
+    inline std::vector<TestCase>& Registry() {
+        static std::vector<TestCase> tests;
+        return tests;
+    }
+
+    inline int& FailedChecks() {
+        static int failed = 0;
+        return failed;
+    }
+
+    struct Registrar {
+        Registrar(const char* name, void (*run)()) {
+            Registry().push_back({ name, run });
+        }
+    };
+
+    inline void Check(bool condition, const char* expression, const char* file, int line) {
+        if (condition)
+            return;
+        FailedChecks()++;
+        std::printf("%s(%d): CHECK(%s) failed\n", file, line, expression);
+    }
+
+    inline int RunTests() {
+        for (auto& test : Registry()) {
+            int failedBefore = FailedChecks();
+            test.Run();
+            std::printf("[%s] %s\n", FailedChecks() == failedBefore ? "  OK  " : "FAILED", test.Name);
+        }
+        std::printf("%zu tests, %d failed checks\n", Registry().size(), FailedChecks());
+        return FailedChecks() == 0 ? 0 : 1;
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static Tests::Registrar name##Registrar(#name, name); \
+    static void name()
+
+#define CHECK(condition) Tests::Check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
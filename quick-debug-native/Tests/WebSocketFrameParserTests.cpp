@@ -0,0 +1,141 @@
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "TestCommon.hpp"
+#include "../Libs/QuickDebug/WebSocketFrameParser.hpp"
+
+using Ext::WebSocketFrameParser;
+using Result = WebSocketFrameParser::Result;
+
+// Frame as a client sends it, masked with a fixed key
+static std::string ClientFrame(unsigned char opcode, std::string_view payload, bool isFinal = true, bool isCompressed = false, bool isMasked = true) {
+    static const unsigned char mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    std::string frame;
+    frame.push_back(static_cast<char>((isFinal ? 0x80 : 0) | (isCompressed ? 0x40 : 0) | opcode));
+
+    unsigned char maskBit = isMasked ? 0x80 : 0;
+    if (payload.size() < 126)
+        frame.push_back(static_cast<char>(maskBit | payload.size()));
+    else if (payload.size() <= 0xFFFF) {
+        frame.push_back(static_cast<char>(maskBit | 126));
+        frame.push_back(static_cast<char>(payload.size() >> 8));
+        frame.push_back(static_cast<char>(payload.size()));
+    }
+    else {
+        frame.push_back(static_cast<char>(maskBit | 127));
+        for (int shift = 56; shift >= 0; shift -= 8)
+            frame.push_back(static_cast<char>(static_cast<uint64_t>(payload.size()) >> shift));
+    }
+
+    if (!isMasked)
+        return frame.append(payload);
+
+    frame.append(reinterpret_cast<const char*>(mask), 4);
+    for (size_t i = 0; i < payload.size(); ++i)
+        frame.push_back(static_cast<char>(payload[i] ^ mask[i % 4]));
+    return frame;
+}
+
+static void Write(WebSocketFrameParser& parser, std::string_view bytes) {
+    std::memcpy(parser.PrepareWrite(bytes.size()), bytes.data(), bytes.size());
+    parser.CommitWrite(bytes.size());
+}
+
+TEST(ParsesTextMessage) {
+    WebSocketFrameParser parser;
+    Write(parser, ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "Amplitude;2.5"));
+
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Opcode() == WebSocketFrameParser::OPCODE_TEXT);
+    CHECK(parser.Payload() == "Amplitude;2.5");
+    CHECK(parser.Next() == Result::NeedMoreData);
+}
+
+TEST(WaitsForFramesReceivedInPieces) {
+    WebSocketFrameParser parser;
+    std::string frames = ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "first") + ClientFrame(WebSocketFrameParser::OPCODE_BINARY, std::string(300, 'x'));
+
+    std::string messages;
+    for (char byte : frames) {
+        Write(parser, std::string_view(&byte, 1));
+        for (auto result = parser.Next(); result != Result::NeedMoreData; result = parser.Next()) {
+            CHECK(result == Result::Message);
+            messages += std::string(parser.Payload()) + "|";
+        }
+    }
+    CHECK(messages == "first|" + std::string(300, 'x') + "|");
+}
+
+TEST(DecodesExtendedPayloadLengths) {
+    WebSocketFrameParser parser;
+    std::string medium(1000, 'm');
+    std::string large(70000, 'l');
+    Write(parser, ClientFrame(WebSocketFrameParser::OPCODE_TEXT, medium) + ClientFrame(WebSocketFrameParser::OPCODE_BINARY, large));
+
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Payload() == medium);
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Opcode() == WebSocketFrameParser::OPCODE_BINARY);
+    CHECK(parser.Payload() == large);
+}
+
+TEST(ReassemblesFragmentsAroundControlFrames) {
+    WebSocketFrameParser parser;
+    Write(parser, ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "Hel", false)
+        + ClientFrame(WebSocketFrameParser::OPCODE_PING, "ping")
+        + ClientFrame(WebSocketFrameParser::OPCODE_CONTINUATION, "lo ", false)
+        + ClientFrame(WebSocketFrameParser::OPCODE_CONTINUATION, "World"));
+
+    CHECK(parser.Next() == Result::Ping);
+    CHECK(parser.Payload() == "ping");
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Opcode() == WebSocketFrameParser::OPCODE_TEXT);
+    CHECK(parser.Payload() == "Hello World");
+}
+
+TEST(ReturnsCloseWithStatus) {
+    WebSocketFrameParser parser;
+    Write(parser, ClientFrame(WebSocketFrameParser::OPCODE_CLOSE, std::string_view("\x03\xE8", 2)));
+
+    CHECK(parser.Next() == Result::Close);
+    CHECK(parser.Payload() == std::string_view("\x03\xE8", 2));
+}
+
+TEST(RejectsInvalidFrames) {
+    auto parse = [](const std::string& bytes) {
+        WebSocketFrameParser parser;
+        Write(parser, bytes);
+        return parser.Next();
+    };
+
+    CHECK(parse(ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "unmasked", true, false, false)) == Result::ProtocolError);
+    CHECK(parse(ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "not negotiated", true, true)) == Result::ProtocolError);
+    CHECK(parse(ClientFrame(WebSocketFrameParser::OPCODE_PING, std::string(126, 'p'))) == Result::ProtocolError);
+    CHECK(parse(ClientFrame(WebSocketFrameParser::OPCODE_PING, "fragmented", false)) == Result::ProtocolError);
+    CHECK(parse(ClientFrame(WebSocketFrameParser::OPCODE_CONTINUATION, "no first fragment")) == Result::ProtocolError);
+    CHECK(parse(ClientFrame(3, "reserved opcode")) == Result::ProtocolError);
+}
+
+TEST(InflatesCompressedMessages) {
+    std::string message;
+    for (int i = 0; i < 100; ++i)
+        message += "QD/Subscribe;sin;cos;";
+
+    Ext::Deflater deflater;
+    std::string compressed;
+    deflater.Compress(message, compressed);
+
+    WebSocketFrameParser parser;
+    parser.EnableCompression();
+    Write(parser, ClientFrame(WebSocketFrameParser::OPCODE_TEXT, compressed, true, true)
+        + ClientFrame(WebSocketFrameParser::OPCODE_TEXT, "plain"));
+
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Payload() == message);
+    CHECK(parser.Next() == Result::Message);
+    CHECK(parser.Payload() == "plain");
+}
+
+int main() {
+    return Tests::RunTests();
+}